@@ -0,0 +1,211 @@
+#include "allocation_audit.hpp"
+
+#ifdef ALLOCATION_AUDIT
+#include <dlfcn.h>
+#include <execinfo.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#endif
+
+namespace {
+
+#ifdef ALLOCATION_AUDIT
+thread_local AllocationAudit* activeAudit = nullptr;
+thread_local bool recording = false;
+
+// Any object of the executable, to find out which shared object an address belongs to.
+const int executableMarker = 0;
+
+// Code that is neither ours nor one of the runtime libraries our code calls into: the
+// Vulkan loader, layers and drivers, GLFW, ...
+bool isForeign(const void* address) {
+    Dl_info info;
+    Dl_info executable;
+    if (dladdr(address, &info) == 0 || dladdr(&executableMarker, &executable) == 0 || info.dli_fname == nullptr) {
+        return false;
+    }
+    if (info.dli_fbase == executable.dli_fbase) {
+        return false;
+    }
+
+    const char* runtimeLibraries[] = {"libstdc++", "libc.so", "libm.so", "libgcc_s"};
+    for (const char* library : runtimeLibraries) {
+        if (std::strstr(info.dli_fname, library) != nullptr) {
+            return false;
+        }
+    }
+    return true;
+}
+#endif
+
+} // namespace
+
+#ifdef ALLOCATION_AUDIT
+// Called by every operator new below with the return address of its caller.
+void recordAuditedAllocation(void* caller) {
+    AllocationAudit* audit = activeAudit;
+    if (audit == nullptr || recording) {
+        return;
+    }
+    recording = true; // dladdr() and backtrace() must not count themselves
+
+    AllocationAudit::CallSite site;
+    site.depth = backtrace(site.frames, static_cast<int>(AllocationAudit::MAX_CALL_SITE_DEPTH));
+
+    site.first = 0;
+    while (site.first < site.depth && site.frames[site.first] != caller) {
+        site.first++;
+    }
+    if (site.first == site.depth) {
+        site.first = 0;
+    }
+
+    // The allocation is ours unless foreign code is somewhere on the way to it. Checking
+    // only the direct caller is not enough: libstdc++ allocates on our behalf, and
+    // libraries may end up in template code of ours that the executable exports.
+    bool ours = true;
+    for (int i = site.first; i < site.depth && ours; i++) {
+        ours = !isForeign(site.frames[i]);
+    }
+
+    if (ours) {
+        if (audit->callSiteCount < AllocationAudit::MAX_CALL_SITES) {
+            audit->callSites[audit->callSiteCount++] = site;
+        }
+        audit->allocationCount++;
+    }
+    recording = false;
+}
+
+namespace {
+
+void* allocate(std::size_t size, void* caller) {
+    recordAuditedAllocation(caller);
+    return std::malloc(size != 0 ? size : 1);
+}
+
+void* allocateAligned(std::size_t size, std::align_val_t alignment, void* caller) {
+    recordAuditedAllocation(caller);
+    std::size_t align = static_cast<std::size_t>(alignment);
+    return std::aligned_alloc(align, (std::max<std::size_t>(size, 1) + align - 1) / align * align);
+}
+
+} // namespace
+
+void* operator new(std::size_t size) {
+    void* memory = allocate(size, __builtin_return_address(0));
+    if (memory == nullptr) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void* operator new[](std::size_t size) {
+    void* memory = allocate(size, __builtin_return_address(0));
+    if (memory == nullptr) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size, __builtin_return_address(0));
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size, __builtin_return_address(0));
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    void* memory = allocateAligned(size, alignment, __builtin_return_address(0));
+    if (memory == nullptr) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    void* memory = allocateAligned(size, alignment, __builtin_return_address(0));
+    if (memory == nullptr) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return allocateAligned(size, alignment, __builtin_return_address(0));
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return allocateAligned(size, alignment, __builtin_return_address(0));
+}
+
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete[](void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete(void* memory, const std::nothrow_t&) noexcept { std::free(memory); }
+void operator delete[](void* memory, const std::nothrow_t&) noexcept { std::free(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::align_val_t) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::size_t, std::align_val_t) noexcept { std::free(memory); }
+void operator delete(void* memory, std::align_val_t, const std::nothrow_t&) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::align_val_t, const std::nothrow_t&) noexcept { std::free(memory); }
+#endif
+
+AllocationAudit::AllocationAudit()
+    : allocationCount(0)
+    , callSites()
+    , callSiteCount(0)
+{}
+
+bool AllocationAudit::isAvailable() {
+#ifdef ALLOCATION_AUDIT
+    return true;
+#else
+    return false;
+#endif
+}
+
+void AllocationAudit::begin() {
+    allocationCount = 0;
+    callSiteCount = 0;
+#ifdef ALLOCATION_AUDIT
+    // The first backtrace() loads the unwinder, which must not happen mid-audit.
+    static thread_local bool warmedUp = false;
+    if (!warmedUp) {
+        void* frame;
+        backtrace(&frame, 1);
+        warmedUp = true;
+    }
+    activeAudit = this;
+#endif
+}
+
+void AllocationAudit::end() {
+#ifdef ALLOCATION_AUDIT
+    activeAudit = nullptr;
+#endif
+}
+
+void AllocationAudit::printCallSites(std::ostream& out) const {
+#ifdef ALLOCATION_AUDIT
+    for (uint32_t i = 0; i < callSiteCount; i++) {
+        out << "  allocation " << i + 1 << ":\n";
+        char** symbols = backtrace_symbols(callSites[i].frames, callSites[i].depth);
+        for (int frame = callSites[i].first; frame < callSites[i].depth; frame++) {
+            out << "    " << (symbols != nullptr ? symbols[frame] : "?") << "\n";
+        }
+        std::free(symbols);
+    }
+    if (allocationCount > callSiteCount) {
+        out << "  (" << allocationCount - callSiteCount << " more)\n";
+    }
+#else
+    (void) out;
+#endif
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+
+// Counts the heap allocations our own code makes on one thread between begin() and
+// end(), with the call sites of the first few. Backed by replacements of the global
+// operator new that only exist in builds defining ALLOCATION_AUDIT (the debug build and
+// the one `make check` runs, see the Makefile); elsewhere the audit compiles to nothing
+// and always reports zero.
+//
+// Allocations made by other libraries (the Vulkan loader, layers and driver, GLFW) are
+// not counted, even when our code called into them: driver host memory is accounted by
+// HostAllocator instead. Allocations inside libstdc++ count towards whoever called it.
+class AllocationAudit {
+public:
+    static constexpr uint32_t MAX_CALL_SITES = 4;
+    static constexpr uint32_t MAX_CALL_SITE_DEPTH = 16;
+
+    AllocationAudit();
+
+    AllocationAudit(const AllocationAudit& source) = delete;
+    AllocationAudit& operator=(const AllocationAudit& source) = delete;
+
+    static bool isAvailable();
+
+    // Starts counting on the calling thread, clearing the previous results. Only one
+    // audit can be active per thread.
+    void begin();
+    void end();
+
+    uint64_t getAllocationCount() const { return allocationCount; }
+    // Writes the recorded call sites as raw backtraces; resolve them with addr2line.
+    void printCallSites(std::ostream& out) const;
+
+private:
+    struct CallSite {
+        void* frames[MAX_CALL_SITE_DEPTH];
+        int depth;
+        int first; // frames before this one are operator new and the audit itself
+    };
+
+    uint64_t allocationCount;
+    CallSite callSites[MAX_CALL_SITES];
+    uint32_t callSiteCount;
+
+    friend void recordAuditedAllocation(void* caller);
+};
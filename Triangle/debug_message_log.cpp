@@ -0,0 +1,237 @@
+#include "debug_message_log.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+// Longest a warning waits in the ring before it is written.
+const std::chrono::milliseconds LOGGER_INTERVAL(50);
+
+// Repeated message IDs listed by printSummary().
+const size_t SUMMARY_TOP_REPEATS = 5;
+
+// Copies source (which may be null) into destination, cutting it off with "..." if needed.
+void copyString(char* destination, const char* source, size_t capacity) {
+    if (source == nullptr) {
+        destination[0] = '\0';
+        return;
+    }
+    size_t length = strnlen(source, capacity);
+    if (length < capacity) {
+        std::memcpy(destination, source, length + 1);
+        return;
+    }
+    std::memcpy(destination, source, capacity - 4);
+    std::memcpy(destination + capacity - 4, "...", 4);
+}
+
+const char* severityName(VkDebugUtilsMessageSeverityFlagBitsEXT severity) {
+    if (severity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT) {
+        return "error";
+    } else if (severity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) {
+        return "warning";
+    } else if (severity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT) {
+        return "info";
+    }
+    return "verbose";
+}
+
+} // namespace
+
+DebugMessageLog::DebugMessageLog()
+    : ring(std::make_unique<Message[]>(RING_SIZE))
+    , enqueuePosition(0)
+    , dequeuePosition(0)
+    , ids(std::make_unique<MessageId[]>(MAX_MESSAGE_IDS))
+    , minimumSeverity(VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT)
+    , errorCount(0)
+    , warningCount(0)
+    , loggedCount(0)
+    , droppedCount(0)
+    , errorPending(false)
+    , out(nullptr)
+    , mutex()
+    , wakeup()
+    , stopping(false)
+    , logger()
+{
+    for (uint32_t i = 0; i < RING_SIZE; i++) {
+        ring[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+DebugMessageLog::~DebugMessageLog() {
+    stop();
+}
+
+void DebugMessageLog::start(std::ostream& out) {
+    this->out = &out;
+    stopping = false;
+    logger = std::thread(&DebugMessageLog::loggerLoop, this);
+}
+
+void DebugMessageLog::stop() {
+    if (!logger.joinable()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeup.notify_all();
+    logger.join();
+}
+
+void DebugMessageLog::setMinimumSeverity(VkDebugUtilsMessageSeverityFlagBitsEXT severity) {
+    minimumSeverity.store(severity, std::memory_order_relaxed);
+}
+
+void DebugMessageLog::populateCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo) {
+    uint32_t minimum = minimumSeverity.load(std::memory_order_relaxed);
+    createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+    for (VkDebugUtilsMessageSeverityFlagBitsEXT severity : {VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT, VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT,
+             VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT, VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT}) {
+        if (static_cast<uint32_t>(severity) >= minimum) {
+            createInfo.messageSeverity |= static_cast<VkDebugUtilsMessageSeverityFlagsEXT>(severity);
+        }
+    }
+    createInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+    createInfo.pfnUserCallback = callback;
+    createInfo.pUserData = this;
+}
+
+void DebugMessageLog::printSummary(std::ostream& out) const {
+    uint64_t repeatCount = 0;
+    std::vector<const MessageId*> repeated;
+    for (uint32_t i = 0; i < MAX_MESSAGE_IDS; i++) {
+        uint64_t repeats = ids[i].repeats.load(std::memory_order_relaxed);
+        if (repeats > 0) {
+            repeatCount += repeats;
+            repeated.push_back(&ids[i]);
+        }
+    }
+
+    out << "validation: " << errorCount.load() << " errors, " << warningCount.load() << " warnings; "
+        << loggedCount.load() << " messages logged, " << repeatCount << " repeats suppressed, "
+        << droppedCount.load() << " dropped\n";
+
+    size_t shown = std::min(repeated.size(), SUMMARY_TOP_REPEATS);
+    std::partial_sort(repeated.begin(), repeated.begin() + static_cast<long>(shown), repeated.end(), [](const MessageId* a, const MessageId* b) {
+        return a->repeats.load(std::memory_order_relaxed) > b->repeats.load(std::memory_order_relaxed);
+    });
+    for (size_t i = 0; i < shown; i++) {
+        out << "  " << repeated[i]->repeats.load(std::memory_order_relaxed) << " more times: "
+            << (repeated[i]->name[0] != '\0' ? repeated[i]->name : "(unnamed)") << " (" << repeated[i]->id.load(std::memory_order_relaxed) << ")\n";
+    }
+}
+
+VKAPI_ATTR VkBool32 VKAPI_CALL DebugMessageLog::callback(VkDebugUtilsMessageSeverityFlagBitsEXT severity, [[maybe_unused]] VkDebugUtilsMessageTypeFlagsEXT types,
+    const VkDebugUtilsMessengerCallbackDataEXT* callbackData, void* userData) {
+    static_cast<DebugMessageLog*>(userData)->receive(severity, *callbackData);
+    return VK_FALSE;
+}
+
+void DebugMessageLog::receive(VkDebugUtilsMessageSeverityFlagBitsEXT severity, const VkDebugUtilsMessengerCallbackDataEXT& callbackData) {
+    if (static_cast<uint32_t>(severity) < minimumSeverity.load(std::memory_order_relaxed)) {
+        return;
+    }
+    if (severity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT) {
+        errorCount.fetch_add(1, std::memory_order_relaxed);
+    } else if (severity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) {
+        warningCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (isRepeat(callbackData)) {
+        return;
+    }
+
+    uint64_t ticket = enqueuePosition.load(std::memory_order_relaxed);
+    Message* slot = nullptr;
+    while (true) {
+        slot = &ring[ticket & (RING_SIZE - 1)];
+        uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+        if (sequence == ticket) {
+            if (enqueuePosition.compare_exchange_weak(ticket, ticket + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (sequence < ticket) {
+            droppedCount.fetch_add(1, std::memory_order_relaxed); // the logger has not freed the slot yet
+            return;
+        } else {
+            ticket = enqueuePosition.load(std::memory_order_relaxed); // another thread took the ticket
+        }
+    }
+
+    slot->severity = severity;
+    copyString(slot->text, callbackData.pMessage, MAX_MESSAGE_LENGTH);
+    slot->sequence.store(ticket + 1, std::memory_order_release);
+
+    if (severity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT) {
+        // Without the mutex the logger can miss this, in which case LOGGER_INTERVAL still bounds the delay.
+        errorPending.store(true, std::memory_order_relaxed);
+        wakeup.notify_one();
+    }
+}
+
+bool DebugMessageLog::isRepeat(const VkDebugUtilsMessengerCallbackDataEXT& callbackData) {
+    if (callbackData.messageIdNumber == 0) {
+        return false; // messages without an ID (the loader's, for one) are all logged
+    }
+
+    int64_t id = callbackData.messageIdNumber;
+    // The validation layer's IDs are already hashes (of the VUID).
+    uint32_t start = static_cast<uint32_t>(callbackData.messageIdNumber) & (MAX_MESSAGE_IDS - 1);
+    for (uint32_t probe = 0; probe < MAX_MESSAGE_IDS; probe++) {
+        MessageId& entry = ids[(start + probe) & (MAX_MESSAGE_IDS - 1)];
+        int64_t current = entry.id.load(std::memory_order_acquire);
+        if (current == EMPTY_ID) {
+            if (entry.id.compare_exchange_strong(current, id, std::memory_order_acq_rel)) {
+                copyString(entry.name, callbackData.pMessageIdName, MAX_ID_NAME_LENGTH);
+                return false;
+            }
+            // Another thread took the entry; current is now its ID.
+        }
+        if (current == id) {
+            entry.repeats.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false; // table full
+}
+
+void DebugMessageLog::loggerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping) {
+        lock.unlock();
+        drain();
+        lock.lock();
+        wakeup.wait_for(lock, LOGGER_INTERVAL, [this] { return stopping || errorPending.load(std::memory_order_relaxed); });
+    }
+    lock.unlock();
+    drain();
+}
+
+void DebugMessageLog::drain() {
+    errorPending.store(false, std::memory_order_relaxed);
+
+    bool written = false;
+    while (true) {
+        Message& slot = ring[dequeuePosition & (RING_SIZE - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != dequeuePosition + 1) {
+            break;
+        }
+        *out << "validation layer: " << severityName(slot.severity) << ": " << slot.text << '\n';
+        slot.sequence.store(dequeuePosition + RING_SIZE, std::memory_order_release);
+        dequeuePosition++;
+        loggedCount.fetch_add(1, std::memory_order_relaxed);
+        written = true;
+    }
+
+    if (written) {
+        out->flush();
+    }
+}
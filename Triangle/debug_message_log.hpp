@@ -0,0 +1,103 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+
+enum class ValidationMode {
+    Full,            // VK_LAYER_KHRONOS_validation with its default checks
+    Synchronization, // only synchronization validation (hazards between commands and queues)
+    Off
+};
+
+// Debug utils messenger callback that costs the calling thread as little as possible: no
+// locks, allocations or I/O. Messages below the severity filter are rejected first; of the
+// rest only the first message with each ID is copied, into a lock-free ring that a
+// background thread writes out, flushing once per batch rather than per message. Repeats
+// are only counted, and printSummary() lists the most frequent ones. When the logger falls
+// RING_SIZE messages behind, messages are dropped and counted.
+class DebugMessageLog {
+public:
+    static constexpr uint32_t RING_SIZE = 256; // power of two
+    static constexpr uint32_t MAX_MESSAGE_LENGTH = 2048; // longer messages are cut off
+    static constexpr uint32_t MAX_MESSAGE_IDS = 1024; // power of two; further IDs are not deduplicated
+    static constexpr uint32_t MAX_ID_NAME_LENGTH = 128;
+
+    DebugMessageLog();
+    ~DebugMessageLog();
+
+    DebugMessageLog(const DebugMessageLog& source) = delete;
+    DebugMessageLog& operator=(const DebugMessageLog& source) = delete;
+
+    // Start before vkCreateInstance, so that the messages about instance creation are
+    // logged as they come too.
+    void start(std::ostream& out);
+    void stop(); // writes whatever is still queued, then joins the logger thread
+
+    // Can change at any time. The layers do not even generate messages below the severity
+    // that was set when populateCreateInfo() was called, though.
+    void setMinimumSeverity(VkDebugUtilsMessageSeverityFlagBitsEXT severity);
+    void populateCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo);
+
+    void printSummary(std::ostream& out) const;
+
+private:
+    // Slot of a bounded multi-producer queue (Dmitry Vyukov's): free for the producer that
+    // took ticket t when sequence == t, readable once it stores t + 1.
+    struct Message {
+        std::atomic<uint64_t> sequence;
+        VkDebugUtilsMessageSeverityFlagBitsEXT severity;
+        char text[MAX_MESSAGE_LENGTH];
+        Message()
+            : sequence(0)
+            , severity(VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT)
+            , text()
+        {}
+    };
+
+    static constexpr int64_t EMPTY_ID = std::numeric_limits<int64_t>::min();
+
+    // Open addressing table from message ID number to the number of repeats suppressed.
+    struct MessageId {
+        std::atomic<int64_t> id; // EMPTY_ID while unused
+        std::atomic<uint64_t> repeats;
+        char name[MAX_ID_NAME_LENGTH]; // written once by the thread that inserted id
+        MessageId()
+            : id(EMPTY_ID)
+            , repeats(0)
+            , name()
+        {}
+    };
+
+    std::unique_ptr<Message[]> ring;
+    std::atomic<uint64_t> enqueuePosition;
+    uint64_t dequeuePosition; // logger thread only
+    std::unique_ptr<MessageId[]> ids;
+
+    std::atomic<uint32_t> minimumSeverity;
+    std::atomic<uint64_t> errorCount; // including repeats
+    std::atomic<uint64_t> warningCount;
+    std::atomic<uint64_t> loggedCount;
+    std::atomic<uint64_t> droppedCount;
+    std::atomic<bool> errorPending;
+
+    std::ostream* out;
+    std::mutex mutex;
+    std::condition_variable wakeup; // errors are written right away, the rest every LOGGER_INTERVAL
+    bool stopping;
+    std::thread logger;
+
+    static VKAPI_ATTR VkBool32 VKAPI_CALL callback(VkDebugUtilsMessageSeverityFlagBitsEXT severity, VkDebugUtilsMessageTypeFlagsEXT types,
+        const VkDebugUtilsMessengerCallbackDataEXT* callbackData, void* userData);
+    void receive(VkDebugUtilsMessageSeverityFlagBitsEXT severity, const VkDebugUtilsMessengerCallbackDataEXT& callbackData);
+    bool isRepeat(const VkDebugUtilsMessengerCallbackDataEXT& callbackData);
+    void loggerLoop();
+    void drain();
+};
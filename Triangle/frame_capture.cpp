@@ -0,0 +1,329 @@
+#include "frame_capture.hpp"
+#include "image_io.hpp"
+#include "vulkan_memory.hpp"
+
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+// Buffers beyond one per frame in flight: the encoder can hold one and fall a frame
+// behind before frames are dropped.
+const uint32_t EXTRA_CAPTURE_SLOTS = 2;
+
+bool isBgra(VkFormat format) {
+    return format == VK_FORMAT_B8G8R8A8_UNORM || format == VK_FORMAT_B8G8R8A8_SRGB;
+}
+
+} // namespace
+
+FrameCapture::FrameCapture()
+    : directory()
+    , fileFormat(CaptureFileFormat::Png)
+    , device(VK_NULL_HANDLE)
+    , extent()
+    , format(VK_FORMAT_UNDEFINED)
+    , coherent(true)
+    , slots()
+    , inFlightSlots()
+    , mutex()
+    , queueChanged()
+    , queue()
+    , queueHead(0)
+    , queueCount(0)
+    , stopping(false)
+    , frameCounter(0)
+    , selectedFrame()
+    , writtenCount(0)
+    , droppedCount(0)
+    , encoder()
+    , rgba()
+    , rawStream()
+    , rawStreamExtent()
+{}
+
+FrameCapture::~FrameCapture() {
+    stop();
+}
+
+void FrameCapture::start(const std::string& directory, CaptureFileFormat fileFormat, uint32_t framesInFlight) {
+    std::filesystem::create_directories(directory);
+
+    this->directory = directory;
+    this->fileFormat = fileFormat;
+    inFlightSlots.assign(framesInFlight, std::nullopt);
+    slots.reserve(framesInFlight + EXTRA_CAPTURE_SLOTS);
+    queue.assign(framesInFlight + EXTRA_CAPTURE_SLOTS, 0);
+    stopping = false;
+
+    encoder = std::thread(&FrameCapture::encoderLoop, this);
+}
+
+void FrameCapture::stop() {
+    if (!encoder.joinable()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    queueChanged.notify_all();
+    encoder.join();
+    rawStream.close();
+}
+
+bool FrameCapture::isFormatSupported(VkFormat format) {
+    return isBgra(format) || format == VK_FORMAT_R8G8B8A8_UNORM || format == VK_FORMAT_R8G8B8A8_SRGB;
+}
+
+void FrameCapture::createBuffers(VkDevice device, VkPhysicalDevice physicalDevice, VkExtent2D extent, VkFormat format, const VkAllocationCallbacks* allocator) {
+    if (!isFormatSupported(format)) {
+        throw std::runtime_error("frame capture does not support the swapchain format!");
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    waitForEncoder(lock);
+
+    this->device = device;
+    this->extent = extent;
+    this->format = format;
+
+    VkDeviceSize size = static_cast<VkDeviceSize>(extent.width) * extent.height * 4;
+    for (uint32_t i = 0; i < queue.size(); i++) {
+        Slot slot{};
+        slot.state = SlotState::Free;
+
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateBuffer(device, &bufferInfo, allocator, &slot.buffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create capture buffer!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(device, slot.buffer, &memRequirements);
+
+        // The CPU reads every byte, so cached memory is worth a vkInvalidateMappedMemoryRanges.
+        std::optional<uint32_t> memoryType = findMemoryType(physicalDevice, memRequirements.memoryTypeBits,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+        coherent = true;
+        if (!memoryType.has_value()) {
+            memoryType = findMemoryType(physicalDevice, memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+            coherent = !memoryType.has_value();
+        }
+        if (!memoryType.has_value()) {
+            memoryType = findMemoryType(physicalDevice, memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        }
+        if (!memoryType.has_value()) {
+            throw std::runtime_error("failed to find host visible memory for frame capture!");
+        }
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = memRequirements.size;
+        allocInfo.memoryTypeIndex = memoryType.value();
+
+        if (vkAllocateMemory(device, &allocInfo, allocator, &slot.memory) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate capture buffer memory!");
+        }
+        vkBindBufferMemory(device, slot.buffer, slot.memory, 0);
+
+        // Stays mapped for the buffer's lifetime.
+        void* mapped = nullptr;
+        if (vkMapMemory(device, slot.memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS) {
+            throw std::runtime_error("failed to map capture buffer memory!");
+        }
+        slot.mapped = static_cast<const uint8_t*>(mapped);
+
+        slots.push_back(slot);
+    }
+}
+
+void FrameCapture::destroyBuffers(VkDevice device, const VkAllocationCallbacks* allocator) {
+    // The device is idle, so copies still owned by a frame in flight are complete.
+    for (uint32_t frame = 0; frame < inFlightSlots.size(); frame++) {
+        frameCompleted(frame);
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    waitForEncoder(lock);
+
+    for (const auto& slot : slots) {
+        vkUnmapMemory(device, slot.memory);
+        vkDestroyBuffer(device, slot.buffer, allocator);
+        vkFreeMemory(device, slot.memory, allocator);
+    }
+    slots.clear();
+}
+
+void FrameCapture::recordCopy(VkCommandBuffer commandBuffer, VkImage image, uint32_t frameInFlight) {
+    std::optional<uint32_t> slotIndex;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        uint64_t frameNumber = frameCounter++;
+        if (selectedFrame.has_value() && selectedFrame != frameNumber) {
+            return;
+        }
+        for (uint32_t i = 0; i < slots.size(); i++) {
+            if (slots[i].state == SlotState::Free) {
+                slots[i].state = SlotState::Copying;
+                slots[i].frameNumber = frameNumber;
+                slotIndex = i;
+                break;
+            }
+        }
+        if (!slotIndex.has_value()) {
+            droppedCount++;
+            return;
+        }
+    }
+    inFlightSlots[frameInFlight] = slotIndex;
+
+    const Slot& slot = slots[slotIndex.value()];
+
+    VkBufferImageCopy region{};
+    region.bufferOffset = 0;
+    region.bufferRowLength = 0; // tightly packed
+    region.bufferImageHeight = 0;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = {0, 0, 0};
+    region.imageExtent = {extent.width, extent.height, 1};
+
+    vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.buffer, 1, &region);
+
+    // Makes the copy visible to host reads once the fence has signaled.
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = slot.buffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+void FrameCapture::frameCompleted(uint32_t frameInFlight) {
+    if (frameInFlight >= inFlightSlots.size() || !inFlightSlots[frameInFlight].has_value()) {
+        return;
+    }
+
+    uint32_t slotIndex = inFlightSlots[frameInFlight].value();
+    inFlightSlots[frameInFlight] = std::nullopt;
+
+    if (!coherent) {
+        VkMappedMemoryRange range{};
+        range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        range.memory = slots[slotIndex].memory;
+        range.offset = 0;
+        range.size = VK_WHOLE_SIZE;
+        vkInvalidateMappedMemoryRanges(device, 1, &range);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        slots[slotIndex].state = SlotState::Queued;
+        queue[(queueHead + queueCount) % queue.size()] = slotIndex;
+        queueCount++;
+    }
+    queueChanged.notify_all();
+}
+
+void FrameCapture::printSummary(std::ostream& out) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    out << "frame capture: " << writtenCount << " frames written to " << directory << ", " << droppedCount << " dropped\n";
+}
+
+void FrameCapture::waitForEncoder(std::unique_lock<std::mutex>& lock) {
+    queueChanged.wait(lock, [this] {
+        for (const auto& slot : slots) {
+            if (slot.state == SlotState::Queued || slot.state == SlotState::Encoding) {
+                return false;
+            }
+        }
+        return true;
+    });
+}
+
+void FrameCapture::encoderLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        queueChanged.wait(lock, [this] { return stopping || queueCount > 0; });
+        if (queueCount == 0) {
+            return; // stopping with nothing left to write
+        }
+
+        uint32_t slotIndex = queue[queueHead];
+        queueHead = (queueHead + 1) % queue.size();
+        queueCount--;
+        slots[slotIndex].state = SlotState::Encoding;
+        Slot slot = slots[slotIndex];
+        VkExtent2D slotExtent = extent;
+        VkFormat slotFormat = format;
+
+        lock.unlock();
+        bool written = true;
+        try {
+            encode(slot, slotExtent, slotFormat);
+        } catch (const std::exception& e) {
+            std::cerr << "frame capture: " << e.what() << "\n";
+            written = false;
+        }
+        lock.lock();
+
+        slots[slotIndex].state = SlotState::Free;
+        if (written) {
+            writtenCount++;
+        } else {
+            droppedCount++;
+        }
+        queueChanged.notify_all();
+    }
+}
+
+void FrameCapture::encode(const Slot& slot, VkExtent2D extent, VkFormat format) {
+    size_t size = static_cast<size_t>(extent.width) * extent.height * 4;
+    rgba.resize(size);
+
+    // Swapchain images are usually BGRA, and their alpha is whatever the compositor ignores.
+    bool swap = isBgra(format);
+    for (size_t i = 0; i < size; i += 4) {
+        rgba[i + 0] = slot.mapped[i + (swap ? 2 : 0)];
+        rgba[i + 1] = slot.mapped[i + 1];
+        rgba[i + 2] = slot.mapped[i + (swap ? 0 : 2)];
+        rgba[i + 3] = 0xff;
+    }
+
+    if (fileFormat == CaptureFileFormat::Png) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "frame_%06llu.png", static_cast<unsigned long long>(slot.frameNumber));
+        writePng((std::filesystem::path(directory) / name).string(), extent.width, extent.height, rgba.data());
+        return;
+    }
+
+    // A raw stream has no header, so every extent gets its own file.
+    if (!rawStream.is_open() || rawStreamExtent.width != extent.width || rawStreamExtent.height != extent.height) {
+        rawStream.close();
+        std::string name = "frames_" + std::to_string(extent.width) + "x" + std::to_string(extent.height) + ".rgba";
+        rawStream.open(std::filesystem::path(directory) / name, std::ios::binary | std::ios::app);
+        if (!rawStream.is_open()) {
+            throw std::runtime_error("failed to open " + name + " for writing!");
+        }
+        rawStreamExtent = extent;
+    }
+    rawStream.write(reinterpret_cast<const char*>(rgba.data()), static_cast<std::streamsize>(size));
+    if (!rawStream) {
+        throw std::runtime_error("failed to write raw frame!");
+    }
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class CaptureFileFormat {
+    Png, // one frame_NNNNNN.png per frame
+    Raw  // RGBA8 frames appended to frames_WxH.rgba, e.g. for ffmpeg -f rawvideo
+};
+
+// Asynchronous readback of rendered frames. recordCopy() copies a color image into one
+// of a small ring of host-visible buffers; once the frame's fence has signaled,
+// frameCompleted() hands the buffer to a background thread that writes it to disk.
+// The render thread never waits for the encoder: when every buffer is busy the frame
+// is dropped and counted instead.
+class FrameCapture {
+public:
+    FrameCapture();
+    ~FrameCapture();
+
+    FrameCapture(const FrameCapture& source);
+    FrameCapture& operator=(const FrameCapture& source);
+
+    void start(const std::string& directory, CaptureFileFormat fileFormat, uint32_t framesInFlight);
+    void stop(); // writes whatever is still queued, then joins the encoder thread
+    bool isActive() const { return encoder.joinable(); }
+
+    static bool isFormatSupported(VkFormat format);
+
+    // Only captures the frame with this number (frames count from 0 in recording order);
+    // the others are skipped without counting as drops. Used by the golden image tests.
+    void selectFrame(std::optional<uint64_t> frameNumber) { selectedFrame = frameNumber; }
+
+    // Buffers follow the captured image's extent, so they are rebuilt with the swapchain.
+    // Both wait for the encoder to finish the buffers it holds; call with the device idle.
+    void createBuffers(VkDevice device, VkPhysicalDevice physicalDevice, VkExtent2D extent, VkFormat format, const VkAllocationCallbacks* allocator);
+    void destroyBuffers(VkDevice device, const VkAllocationCallbacks* allocator);
+
+    // Records the copy of image (in TRANSFER_SRC_OPTIMAL, same extent and format as the
+    // buffers) for the frame using frameInFlight's fence.
+    void recordCopy(VkCommandBuffer commandBuffer, VkImage image, uint32_t frameInFlight);
+    // Called once frameInFlight's fence has signaled.
+    void frameCompleted(uint32_t frameInFlight);
+
+    void printSummary(std::ostream& out) const;
+
+private:
+    enum class SlotState {
+        Free,
+        Copying,  // owned by a frame in flight
+        Queued,   // waiting for the encoder
+        Encoding
+    };
+
+    struct Slot {
+        VkBuffer buffer;
+        VkDeviceMemory memory;
+        const uint8_t* mapped;
+        uint64_t frameNumber;
+        SlotState state;
+    };
+
+    std::string directory;
+    CaptureFileFormat fileFormat;
+
+    VkDevice device;
+    VkExtent2D extent;
+    VkFormat format;
+    bool coherent;
+    std::vector<Slot> slots;
+    std::vector<std::optional<uint32_t>> inFlightSlots; // indexed by frame in flight
+
+    // Guards slot states, the queue and the counters. Only held for bookkeeping, never
+    // while encoding or writing files.
+    mutable std::mutex mutex;
+    std::condition_variable queueChanged;
+    std::vector<uint32_t> queue; // ring of slot indices, capacity slots.size()
+    size_t queueHead;
+    size_t queueCount;
+    bool stopping;
+
+    uint64_t frameCounter;
+    std::optional<uint64_t> selectedFrame;
+    uint64_t writtenCount;
+    uint64_t droppedCount;
+
+    std::thread encoder;
+    std::vector<uint8_t> rgba; // encoder thread only
+    std::ofstream rawStream;   // encoder thread only
+    VkExtent2D rawStreamExtent;
+
+    void encoderLoop();
+    void encode(const Slot& slot, VkExtent2D extent, VkFormat format);
+    void waitForEncoder(std::unique_lock<std::mutex>& lock);
+};
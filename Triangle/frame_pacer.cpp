@@ -0,0 +1,130 @@
+#include "frame_pacer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+namespace {
+
+// Starting guess for how much a sleep overshoots, and the bounds for the learned value.
+const auto INITIAL_SPIN_THRESHOLD = std::chrono::microseconds(1000);
+const auto MIN_SPIN_THRESHOLD = std::chrono::microseconds(50);
+const auto MAX_SPIN_THRESHOLD = std::chrono::microseconds(4000);
+
+} // namespace
+
+FramePacer::FramePacer()
+    : targetRate(0.0)
+    , period(Clock::duration::zero())
+    , deadline()
+    , lastFrame()
+    , started(false)
+    , spinThreshold(INITIAL_SPIN_THRESHOLD)
+    , sleepTime(Clock::duration::zero())
+    , spinTime(Clock::duration::zero())
+    , intervalCount(0)
+    , intervalMean(0.0)
+    , intervalM2(0.0)
+    , intervalMax(0.0)
+    , histogram()
+{}
+
+void FramePacer::setTargetRate(double framesPerSecond) {
+    targetRate = std::max(framesPerSecond, 0.0);
+    period = targetRate > 0.0
+        ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / targetRate))
+        : Clock::duration::zero();
+}
+
+void FramePacer::waitForNextFrame() {
+    Clock::time_point now = Clock::now();
+
+    if (period > Clock::duration::zero() && started) {
+        // A frame that ran over budget starts the schedule over instead of rushing the
+        // next frames to catch up, which would only trade one long frame for short ones.
+        deadline += period;
+        if (deadline < now) {
+            deadline = now;
+        }
+        sleepUntil(deadline);
+        now = Clock::now();
+    } else {
+        deadline = now;
+    }
+
+    if (started) {
+        recordInterval(std::chrono::duration<double, std::milli>(now - lastFrame).count());
+    }
+    lastFrame = now;
+    started = true;
+}
+
+void FramePacer::sleepUntil(Clock::time_point target) {
+    Clock::time_point sleepStart = Clock::now();
+    Clock::time_point wakeTarget = target - spinThreshold;
+    if (wakeTarget > sleepStart) {
+        std::this_thread::sleep_until(wakeTarget);
+        Clock::time_point woke = Clock::now();
+        sleepTime += woke - sleepStart;
+
+        // Track the overshoot: jump up on a late wake-up, decay slowly while sleeps are
+        // punctual, so the spin stays as short as the OS allows.
+        Clock::duration overshoot = woke - wakeTarget;
+        if (overshoot > spinThreshold) {
+            spinThreshold = overshoot;
+        } else {
+            spinThreshold -= (spinThreshold - overshoot) / 16;
+        }
+        spinThreshold = std::clamp<Clock::duration>(spinThreshold, MIN_SPIN_THRESHOLD, MAX_SPIN_THRESHOLD);
+    }
+
+    Clock::time_point spinStart = Clock::now();
+    while (Clock::now() < target) {
+        std::this_thread::yield();
+    }
+    spinTime += Clock::now() - spinStart;
+}
+
+void FramePacer::recordInterval(double ms) {
+    intervalCount++;
+    double delta = ms - intervalMean;
+    intervalMean += delta / static_cast<double>(intervalCount);
+    intervalM2 += delta * (ms - intervalMean);
+    intervalMax = std::max(intervalMax, ms);
+
+    size_t bin = std::min<size_t>(static_cast<size_t>(ms * 1000.0 / HISTOGRAM_BIN_US), HISTOGRAM_BINS - 1);
+    histogram[bin]++;
+}
+
+double FramePacer::percentile(double fraction) const {
+    uint64_t rank = static_cast<uint64_t>(std::ceil(fraction * static_cast<double>(intervalCount)));
+    uint64_t seen = 0;
+    for (uint32_t bin = 0; bin < HISTOGRAM_BINS; bin++) {
+        seen += histogram[bin];
+        if (seen >= rank) {
+            // The last bin also holds every longer interval, so its only upper edge is the longest.
+            return bin + 1 < HISTOGRAM_BINS ? (bin + 1) * HISTOGRAM_BIN_US / 1000.0 : intervalMax; // upper edge of the bin
+        }
+    }
+    return intervalMax;
+}
+
+void FramePacer::printSummary(std::ostream& out) const {
+    if (intervalCount < 2) {
+        return;
+    }
+
+    double stddev = std::sqrt(intervalM2 / static_cast<double>(intervalCount - 1));
+    double frames = static_cast<double>(intervalCount);
+    out << "frame pacing (";
+    if (targetRate > 0.0) {
+        out << "target " << targetRate << " Hz";
+    } else {
+        out << "unlimited";
+    }
+    out << "): " << intervalCount << " frames, interval "
+        << intervalMean << " ms mean, " << stddev << " ms stddev, "
+        << percentile(0.99) << " ms p99, " << intervalMax << " ms max; per frame "
+        << std::chrono::duration<double, std::milli>(sleepTime).count() / frames << " ms asleep, "
+        << std::chrono::duration<double, std::milli>(spinTime).count() / frames << " ms spinning\n";
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+// Caps the frame rate by waiting for an evenly spaced deadline before each frame.
+// The wait sleeps while the deadline is far away and spins for the last stretch,
+// because OS sleeps overshoot by anywhere from tens of microseconds to milliseconds.
+// How early to stop sleeping is learned from the overshoot actually observed.
+class FramePacer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    FramePacer();
+
+    // 0 disables the limit; frame intervals are still measured.
+    void setTargetRate(double framesPerSecond);
+    double getTargetRate() const { return targetRate; }
+
+    // Blocks until the next frame should start, then records the interval since the last one.
+    void waitForNextFrame();
+
+    void printSummary(std::ostream& out) const;
+
+private:
+    // Frame interval histogram for the percentiles, HISTOGRAM_BIN_US wide bins; longer
+    // intervals land in the last bin.
+    static constexpr uint32_t HISTOGRAM_BINS = 1000;
+    static constexpr uint32_t HISTOGRAM_BIN_US = 100;
+
+    double targetRate;
+    Clock::duration period;
+    Clock::time_point deadline;
+    Clock::time_point lastFrame;
+    bool started;
+
+    Clock::duration spinThreshold; // stop sleeping this long before the deadline
+    Clock::duration sleepTime;
+    Clock::duration spinTime;
+
+    // Running mean and variance of the frame interval in ms (Welford).
+    uint64_t intervalCount;
+    double intervalMean;
+    double intervalM2;
+    double intervalMax;
+    std::array<uint32_t, HISTOGRAM_BINS> histogram;
+
+    void sleepUntil(Clock::time_point target);
+    void recordInterval(double ms);
+    double percentile(double fraction) const;
+};
@@ -0,0 +1,259 @@
+#include "host_allocator.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace {
+
+const char* SCOPE_NAMES[] = {"command", "object", "cache", "device", "instance"};
+
+size_t alignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+std::atomic<uint64_t> nextAllocatorId(1);
+
+// The arena the calling thread last used, and the allocator it belongs to.
+struct CachedArena {
+    uint64_t allocatorId;
+    void* arena;
+};
+thread_local CachedArena cachedArena = {0, nullptr};
+
+} // namespace
+
+HostAllocator::HostAllocator(size_t arenaSize)
+    : callbacks()
+    , counters()
+    , id(nextAllocatorId.fetch_add(1, std::memory_order_relaxed))
+    , arenaSize(arenaSize)
+    , arenasMutex()
+    , arenas(nullptr)
+    , arenaOverflows(0)
+{
+    callbacks.pUserData = this;
+    callbacks.pfnAllocation = allocationCallback;
+    callbacks.pfnReallocation = reallocationCallback;
+    callbacks.pfnFree = freeCallback;
+    callbacks.pfnInternalAllocation = internalAllocationCallback;
+    callbacks.pfnInternalFree = internalFreeCallback;
+}
+
+HostAllocator::~HostAllocator() {
+    while (arenas != nullptr) {
+        Arena* next = arenas->next;
+        std::free(arenas->memory);
+        arenas->~Arena();
+        std::free(arenas);
+        arenas = next;
+    }
+}
+
+HostAllocationStats HostAllocator::getStats(VkSystemAllocationScope scope) const {
+    const Counters& scopeCounters = counters[static_cast<size_t>(scope)];
+    return HostAllocationStats(
+        scopeCounters.liveBytes.load(std::memory_order_relaxed),
+        scopeCounters.peakBytes.load(std::memory_order_relaxed),
+        scopeCounters.liveAllocations.load(std::memory_order_relaxed),
+        scopeCounters.totalAllocations.load(std::memory_order_relaxed),
+        scopeCounters.internalLiveBytes.load(std::memory_order_relaxed),
+        scopeCounters.internalPeakBytes.load(std::memory_order_relaxed));
+}
+
+void HostAllocator::printSummary(std::ostream& out) const {
+    out << "host allocations (live / peak bytes, live / total allocations):\n";
+    for (size_t scope = 0; scope < SCOPE_COUNT; scope++) {
+        HostAllocationStats stats = getStats(static_cast<VkSystemAllocationScope>(scope));
+        if (stats.totalAllocations == 0 && stats.internalPeakBytes == 0) {
+            continue;
+        }
+        out << "  " << SCOPE_NAMES[scope] << ": " << stats.liveBytes << " / " << stats.peakBytes << " bytes, "
+            << stats.liveAllocations << " / " << stats.totalAllocations << " allocations";
+        if (stats.internalPeakBytes > 0) {
+            out << ", internal " << stats.internalLiveBytes << " / " << stats.internalPeakBytes << " bytes";
+        }
+        out << "\n";
+    }
+
+    std::lock_guard<std::mutex> lock(arenasMutex);
+    uint32_t threads = 0;
+    size_t highWater = 0;
+    for (const Arena* arena = arenas; arena != nullptr; arena = arena->next) {
+        threads++;
+        highWater = std::max(highWater, arena->highWater.load(std::memory_order_relaxed));
+    }
+    out << "  command arenas: " << threads << " threads, " << highWater << " of " << arenaSize << " bytes used at most, "
+        << arenaOverflows.load(std::memory_order_relaxed) << " allocations fell back to the heap\n";
+}
+
+void* HostAllocator::allocate(size_t size, size_t alignment, VkSystemAllocationScope scope) {
+    if (size == 0) {
+        return nullptr;
+    }
+
+    alignment = std::max(alignment, alignof(Header));
+    size_t offset = alignUp(sizeof(Header), alignment);
+    size_t blockSize = offset + size;
+
+    std::byte* block = nullptr;
+    Arena* arena = nullptr;
+    if (scope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND && alignment <= ARENA_ALIGNMENT) {
+        arena = threadArena();
+        block = arena != nullptr ? static_cast<std::byte*>(allocateFromArena(*arena, blockSize)) : nullptr;
+        if (block == nullptr) {
+            arena = nullptr;
+            arenaOverflows.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    if (block == nullptr) {
+        // Straight from the C heap: this is the driver's memory, which AllocationAudit
+        // must not mistake for allocations of ours.
+        block = static_cast<std::byte*>(std::aligned_alloc(alignment, alignUp(blockSize, alignment)));
+        if (block == nullptr) {
+            return nullptr;
+        }
+    }
+
+    std::byte* memory = block + offset;
+    Header* header = headerOf(memory);
+    header->size = size;
+    header->offset = offset;
+    header->scope = static_cast<uint32_t>(scope);
+    header->arena = arena;
+
+    recordAllocation(header->scope, size);
+    return memory;
+}
+
+void* HostAllocator::reallocate(void* original, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+    if (original == nullptr) {
+        return allocate(size, alignment, scope);
+    }
+    if (size == 0) {
+        free(original);
+        return nullptr;
+    }
+
+    // On failure the original allocation must stay untouched, so copy rather than grow in place.
+    void* memory = allocate(size, alignment, scope);
+    if (memory == nullptr) {
+        return nullptr;
+    }
+    std::memcpy(memory, original, std::min(size, headerOf(original)->size));
+    free(original);
+    return memory;
+}
+
+void HostAllocator::free(void* memory) {
+    if (memory == nullptr) {
+        return;
+    }
+
+    Header header = *headerOf(memory);
+    Counters& scopeCounters = counters[header.scope];
+    scopeCounters.liveBytes.fetch_sub(header.size, std::memory_order_relaxed);
+    scopeCounters.liveAllocations.fetch_sub(1, std::memory_order_relaxed);
+
+    if (header.arena != nullptr) {
+        // Individual frees only count down; the owner takes the space back in one go once
+        // nothing lives in the arena.
+        header.arena->live.fetch_sub(1, std::memory_order_release);
+    } else {
+        std::free(static_cast<std::byte*>(memory) - header.offset);
+    }
+}
+
+// Returns the calling thread's arena, creating it on the thread's first command scope
+// allocation. Only that first call per thread (or a switch between allocators) locks.
+HostAllocator::Arena* HostAllocator::threadArena() {
+    if (cachedArena.allocatorId == id) {
+        return static_cast<Arena*>(cachedArena.arena);
+    }
+
+    std::lock_guard<std::mutex> lock(arenasMutex);
+    std::thread::id thread = std::this_thread::get_id();
+    Arena* arena = arenas;
+    while (arena != nullptr && arena->owner != thread) {
+        arena = arena->next;
+    }
+    if (arena == nullptr) {
+        // From the C heap like the driver's other memory, see allocate().
+        std::byte* memory = static_cast<std::byte*>(std::aligned_alloc(ARENA_ALIGNMENT, alignUp(arenaSize, ARENA_ALIGNMENT)));
+        void* storage = std::aligned_alloc(alignof(Arena), alignUp(sizeof(Arena), alignof(Arena)));
+        if (memory == nullptr || storage == nullptr) {
+            std::free(memory);
+            std::free(storage);
+            return nullptr;
+        }
+        arena = new (storage) Arena(memory, thread, arenas);
+        arenas = arena;
+    }
+
+    cachedArena = {id, arena};
+    return arena;
+}
+
+void* HostAllocator::allocateFromArena(Arena& arena, size_t blockSize) {
+    // Nothing can start living in the arena behind the owner's back, so once the count is
+    // zero the owner may rewind; the acquire pairs with the release of the last free.
+    if (arena.live.load(std::memory_order_acquire) == 0) {
+        arena.top = 0;
+    }
+    size_t start = alignUp(arena.top, ARENA_ALIGNMENT);
+    if (start + blockSize > arenaSize) {
+        return nullptr;
+    }
+    arena.top = start + blockSize;
+    arena.live.fetch_add(1, std::memory_order_relaxed);
+    if (arena.top > arena.highWater.load(std::memory_order_relaxed)) {
+        arena.highWater.store(arena.top, std::memory_order_relaxed);
+    }
+    return arena.memory + start;
+}
+
+void HostAllocator::recordAllocation(uint32_t scope, size_t size) {
+    Counters& scopeCounters = counters[scope];
+    uint64_t live = scopeCounters.liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+    raisePeak(scopeCounters.peakBytes, live);
+    scopeCounters.liveAllocations.fetch_add(1, std::memory_order_relaxed);
+    scopeCounters.totalAllocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+void HostAllocator::recordInternalAllocation(uint32_t scope, size_t size) {
+    Counters& scopeCounters = counters[scope];
+    uint64_t live = scopeCounters.internalLiveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+    raisePeak(scopeCounters.internalPeakBytes, live);
+}
+
+HostAllocator::Header* HostAllocator::headerOf(void* memory) {
+    return reinterpret_cast<Header*>(static_cast<std::byte*>(memory) - sizeof(Header));
+}
+
+void HostAllocator::raisePeak(std::atomic<uint64_t>& peak, uint64_t value) {
+    uint64_t current = peak.load(std::memory_order_relaxed);
+    while (value > current && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+void* VKAPI_PTR HostAllocator::allocationCallback(void* userData, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+    return static_cast<HostAllocator*>(userData)->allocate(size, alignment, scope);
+}
+
+void* VKAPI_PTR HostAllocator::reallocationCallback(void* userData, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+    return static_cast<HostAllocator*>(userData)->reallocate(original, size, alignment, scope);
+}
+
+void VKAPI_PTR HostAllocator::freeCallback(void* userData, void* memory) {
+    static_cast<HostAllocator*>(userData)->free(memory);
+}
+
+void VKAPI_PTR HostAllocator::internalAllocationCallback(void* userData, size_t size, VkInternalAllocationType /*type*/, VkSystemAllocationScope scope) {
+    static_cast<HostAllocator*>(userData)->recordInternalAllocation(static_cast<uint32_t>(scope), size);
+}
+
+void VKAPI_PTR HostAllocator::internalFreeCallback(void* userData, size_t size, VkInternalAllocationType /*type*/, VkSystemAllocationScope scope) {
+    HostAllocator* allocator = static_cast<HostAllocator*>(userData);
+    allocator->counters[static_cast<size_t>(scope)].internalLiveBytes.fetch_sub(size, std::memory_order_relaxed);
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <thread>
+
+struct HostAllocationStats {
+    uint64_t liveBytes;
+    uint64_t peakBytes;
+    uint64_t liveAllocations;
+    uint64_t totalAllocations;
+    uint64_t internalLiveBytes; // driver allocations we are only notified about
+    uint64_t internalPeakBytes;
+    HostAllocationStats(
+        uint64_t liveBytes = 0,
+        uint64_t peakBytes = 0,
+        uint64_t liveAllocations = 0,
+        uint64_t totalAllocations = 0,
+        uint64_t internalLiveBytes = 0,
+        uint64_t internalPeakBytes = 0)
+        : liveBytes(liveBytes)
+        , peakBytes(peakBytes)
+        , liveAllocations(liveAllocations)
+        , totalAllocations(totalAllocations)
+        , internalLiveBytes(internalLiveBytes)
+        , internalPeakBytes(internalPeakBytes)
+    {}
+};
+
+// VkAllocationCallbacks that account every driver host allocation to its
+// VkSystemAllocationScope. Command scope allocations only live for the duration of a
+// single vk* call, so they are bump allocated from an arena of the calling thread that
+// rewinds whenever it empties (at the latest when the call returns); arenas do not need
+// resetting per frame, never fragment and take no lock. Everything else, and command
+// allocations that do not fit, goes to the heap. Callable from any thread, as the spec
+// requires; a thread's arena lives as long as the allocator.
+class HostAllocator {
+public:
+    static constexpr size_t DEFAULT_ARENA_SIZE = 256 * 1024; // per thread
+
+    explicit HostAllocator(size_t arenaSize = DEFAULT_ARENA_SIZE);
+    ~HostAllocator();
+
+    HostAllocator(const HostAllocator& source) = delete;
+    HostAllocator& operator=(const HostAllocator& source) = delete;
+
+    // Pass to every vkCreate*/vkDestroy*/vkAllocateMemory/vkFreeMemory call. Objects must
+    // be destroyed with the same callbacks they were created with, and before the allocator.
+    const VkAllocationCallbacks* getCallbacks() const { return &callbacks; }
+
+    HostAllocationStats getStats(VkSystemAllocationScope scope) const;
+    void printSummary(std::ostream& out) const;
+
+private:
+    static constexpr size_t SCOPE_COUNT = VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1;
+    static constexpr size_t ARENA_ALIGNMENT = 64;
+
+    // Command scope arena of one thread. Only that thread allocates from it, but the
+    // driver may free on another, so the live count is atomic; the owner rewinds the arena
+    // when it sees the count at zero.
+    struct Arena {
+        std::byte* memory;
+        size_t top; // owner only
+        std::atomic<uint32_t> live;
+        std::atomic<size_t> highWater;
+        std::thread::id owner;
+        Arena* next; // in arenas
+        Arena(std::byte* memory = nullptr, std::thread::id owner = std::thread::id(), Arena* next = nullptr)
+            : memory(memory)
+            , top(0)
+            , live(0)
+            , highWater(0)
+            , owner(owner)
+            , next(next)
+        {}
+    };
+
+    // Stored in front of every allocation handed to the driver.
+    struct Header {
+        size_t size;
+        size_t offset; // from the start of the underlying block to the user pointer
+        uint32_t scope;
+        Arena* arena; // null for heap allocations
+    };
+
+    struct Counters {
+        std::atomic<uint64_t> liveBytes{0};
+        std::atomic<uint64_t> peakBytes{0};
+        std::atomic<uint64_t> liveAllocations{0};
+        std::atomic<uint64_t> totalAllocations{0};
+        std::atomic<uint64_t> internalLiveBytes{0};
+        std::atomic<uint64_t> internalPeakBytes{0};
+    };
+
+    VkAllocationCallbacks callbacks;
+    std::array<Counters, SCOPE_COUNT> counters;
+
+    const uint64_t id; // tells the threads' cached arenas of different allocators apart
+    size_t arenaSize;
+    mutable std::mutex arenasMutex; // guards the list, taken once per thread
+    Arena* arenas;
+    std::atomic<uint64_t> arenaOverflows;
+
+    void* allocate(size_t size, size_t alignment, VkSystemAllocationScope scope);
+    void* reallocate(void* original, size_t size, size_t alignment, VkSystemAllocationScope scope);
+    void free(void* memory);
+    Arena* threadArena();
+    void* allocateFromArena(Arena& arena, size_t blockSize);
+    void recordAllocation(uint32_t scope, size_t size);
+    void recordInternalAllocation(uint32_t scope, size_t size);
+
+    static Header* headerOf(void* memory);
+    static void raisePeak(std::atomic<uint64_t>& peak, uint64_t value);
+
+    static void* VKAPI_PTR allocationCallback(void* userData, size_t size, size_t alignment, VkSystemAllocationScope scope);
+    static void* VKAPI_PTR reallocationCallback(void* userData, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope);
+    static void VKAPI_PTR freeCallback(void* userData, void* memory);
+    static void VKAPI_PTR internalAllocationCallback(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+    static void VKAPI_PTR internalFreeCallback(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+};
@@ -0,0 +1,215 @@
+#include "image_io.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+namespace {
+
+const uint8_t PNG_SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+
+std::array<uint32_t, 256> makeCrcTable() {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        }
+        table[n] = c;
+    }
+    return table;
+}
+
+uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0) {
+    static const std::array<uint32_t, 256> table = makeCrcTable();
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+void appendBigEndian(std::vector<uint8_t>& out, uint32_t value) {
+    out.push_back(static_cast<uint8_t>(value >> 24));
+    out.push_back(static_cast<uint8_t>(value >> 16));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+void writeChunk(std::ofstream& file, const char type[4], const std::vector<uint8_t>& data) {
+    std::vector<uint8_t> chunk;
+    chunk.reserve(data.size() + 12);
+    appendBigEndian(chunk, static_cast<uint32_t>(data.size()));
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    appendBigEndian(chunk, crc32(chunk.data() + 4, data.size() + 4));
+    file.write(reinterpret_cast<const char*>(chunk.data()), static_cast<std::streamsize>(chunk.size()));
+}
+
+uint32_t readBigEndian(const uint8_t* data) {
+    return (static_cast<uint32_t>(data[0]) << 24) | (static_cast<uint32_t>(data[1]) << 16) | (static_cast<uint32_t>(data[2]) << 8) | data[3];
+}
+
+uint8_t paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) {
+        return static_cast<uint8_t>(a);
+    }
+    return static_cast<uint8_t>(pb <= pc ? b : c);
+}
+
+} // namespace
+
+void writePng(const std::string& filename, uint32_t width, uint32_t height, const uint8_t* rgba) {
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("failed to open " + filename + " for writing!");
+    }
+
+    std::vector<uint8_t> header;
+    appendBigEndian(header, width);
+    appendBigEndian(header, height);
+    header.push_back(8); // bit depth
+    header.push_back(6); // color type: RGBA
+    header.push_back(0); // compression
+    header.push_back(0); // filter
+    header.push_back(0); // interlace
+
+    // Scanlines with filter type 0 in front of every row.
+    size_t rowSize = static_cast<size_t>(width) * 4;
+    std::vector<uint8_t> raw;
+    raw.reserve((rowSize + 1) * height);
+    for (uint32_t y = 0; y < height; y++) {
+        raw.push_back(0);
+        raw.insert(raw.end(), rgba + y * rowSize, rgba + (y + 1) * rowSize);
+    }
+
+    std::vector<uint8_t> zlib;
+    zlib.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+    zlib.push_back(0x78); // deflate, 32K window
+    zlib.push_back(0x01); // no preset dictionary, fastest
+    size_t offset = 0;
+    do {
+        size_t blockSize = std::min<size_t>(raw.size() - offset, 65535);
+        bool last = offset + blockSize == raw.size();
+        zlib.push_back(last ? 1 : 0);
+        zlib.push_back(static_cast<uint8_t>(blockSize));
+        zlib.push_back(static_cast<uint8_t>(blockSize >> 8));
+        zlib.push_back(static_cast<uint8_t>(~blockSize));
+        zlib.push_back(static_cast<uint8_t>(~blockSize >> 8));
+        zlib.insert(zlib.end(), raw.begin() + static_cast<long>(offset), raw.begin() + static_cast<long>(offset + blockSize));
+        offset += blockSize;
+    } while (offset < raw.size());
+
+    uint32_t a = 1, b = 0;
+    for (uint8_t byte : raw) {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    appendBigEndian(zlib, (b << 16) | a);
+
+    file.write(reinterpret_cast<const char*>(PNG_SIGNATURE), sizeof(PNG_SIGNATURE));
+    writeChunk(file, "IHDR", header);
+    writeChunk(file, "IDAT", zlib);
+    writeChunk(file, "IEND", {});
+
+    if (!file) {
+        throw std::runtime_error("failed to write " + filename + "!");
+    }
+}
+
+Image readPng(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("failed to open " + filename + "!");
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    if (data.size() < sizeof(PNG_SIGNATURE) || !std::equal(PNG_SIGNATURE, PNG_SIGNATURE + sizeof(PNG_SIGNATURE), data.begin())) {
+        throw std::runtime_error(filename + " is not a PNG file!");
+    }
+
+    Image image;
+    std::vector<uint8_t> zlib;
+    size_t pos = sizeof(PNG_SIGNATURE);
+    while (pos + 12 <= data.size()) {
+        uint32_t length = readBigEndian(&data[pos]);
+        if (pos + 12 + length > data.size()) {
+            break;
+        }
+        std::string type(data.begin() + static_cast<long>(pos + 4), data.begin() + static_cast<long>(pos + 8));
+        const uint8_t* body = &data[pos + 8];
+
+        if (crc32(&data[pos + 4], length + 4) != readBigEndian(body + length)) {
+            throw std::runtime_error(filename + ": corrupt " + type + " chunk!");
+        }
+        if (type == "IHDR") {
+            image.width = readBigEndian(body);
+            image.height = readBigEndian(body + 4);
+            if (body[8] != 8 || body[9] != 6 || body[12] != 0) {
+                throw std::runtime_error(filename + ": only 8-bit non-interlaced RGBA is supported!");
+            }
+        } else if (type == "IDAT") {
+            zlib.insert(zlib.end(), body, body + length);
+        } else if (type == "IEND") {
+            break;
+        }
+        pos += 12 + length;
+    }
+
+    // Concatenate the stored blocks back into the filtered scanlines.
+    size_t rowSize = static_cast<size_t>(image.width) * 4;
+    std::vector<uint8_t> raw;
+    raw.reserve((rowSize + 1) * image.height);
+    pos = 2;
+    bool last = false;
+    while (!last) {
+        if (pos + 5 > zlib.size()) {
+            throw std::runtime_error(filename + ": truncated image data!");
+        }
+        last = zlib[pos] & 1;
+        if ((zlib[pos] & 6) != 0) {
+            throw std::runtime_error(filename + ": compressed PNGs are not supported, re-create it with writePng()!");
+        }
+        size_t blockSize = zlib[pos + 1] | (static_cast<size_t>(zlib[pos + 2]) << 8);
+        pos += 5;
+        if (pos + blockSize > zlib.size()) {
+            throw std::runtime_error(filename + ": truncated image data!");
+        }
+        raw.insert(raw.end(), zlib.begin() + static_cast<long>(pos), zlib.begin() + static_cast<long>(pos + blockSize));
+        pos += blockSize;
+    }
+    if (raw.size() != (rowSize + 1) * image.height) {
+        throw std::runtime_error(filename + ": unexpected image data size!");
+    }
+
+    image.pixels.resize(rowSize * image.height);
+    for (uint32_t y = 0; y < image.height; y++) {
+        uint8_t filter = raw[y * (rowSize + 1)];
+        const uint8_t* in = &raw[y * (rowSize + 1) + 1];
+        uint8_t* out = &image.pixels[y * rowSize];
+        const uint8_t* up = y > 0 ? out - rowSize : nullptr;
+
+        for (size_t x = 0; x < rowSize; x++) {
+            int a = x >= 4 ? out[x - 4] : 0;
+            int b = up != nullptr ? up[x] : 0;
+            int c = x >= 4 && up != nullptr ? up[x - 4] : 0;
+            int predicted = 0;
+            switch (filter) {
+                case 0: predicted = 0; break;
+                case 1: predicted = a; break;
+                case 2: predicted = b; break;
+                case 3: predicted = (a + b) / 2; break;
+                case 4: predicted = paeth(a, b, c); break;
+                default: throw std::runtime_error(filename + ": invalid scanline filter!");
+            }
+            out[x] = static_cast<uint8_t>(in[x] + predicted);
+        }
+    }
+
+    return image;
+}
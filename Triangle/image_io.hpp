@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 8-bit RGBA image, rows tightly packed top to bottom.
+struct Image {
+    uint32_t width;
+    uint32_t height;
+    std::vector<uint8_t> pixels;
+    Image(uint32_t width = 0, uint32_t height = 0, std::vector<uint8_t> pixels = {})
+        : width(width)
+        , height(height)
+        , pixels(pixels)
+    {}
+};
+
+// Writes an RGBA8 PNG. The zlib stream uses stored (uncompressed) deflate blocks: encoding
+// stays cheap enough for the capture thread and needs no zlib dependency.
+void writePng(const std::string& filename, uint32_t width, uint32_t height, const uint8_t* rgba);
+
+// Reads an RGBA8 PNG with stored deflate blocks, i.e. what writePng() produces. Images
+// compressed by other tools are rejected; re-create them with writePng().
+Image readPng(const std::string& filename);
@@ -0,0 +1,159 @@
+#include "ktx2.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+const uint8_t KTX2_IDENTIFIER[12] = {0xab, 'K', 'T', 'X', ' ', '2', '0', 0xbb, '\r', '\n', 0x1a, '\n'};
+
+// Identifier, nine uint32 header fields and the data format/key-value/supercompression
+// index; the level index follows.
+const size_t KTX2_HEADER_SIZE = 80;
+const size_t KTX2_LEVEL_INDEX_ENTRY_SIZE = 24;
+
+template <typename T>
+T readField(const std::byte* data, size_t offset) {
+    T value;
+    std::memcpy(&value, data + offset, sizeof(T)); // the format is little endian, as is every platform we run on
+    return value;
+}
+
+// Bytes per 4x4 block of the BCn formats.
+uint32_t bcBlockSize(VkFormat format) {
+    switch (format) {
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+    case VK_FORMAT_BC4_UNORM_BLOCK:
+    case VK_FORMAT_BC4_SNORM_BLOCK:
+        return 8;
+    case VK_FORMAT_BC2_UNORM_BLOCK:
+    case VK_FORMAT_BC2_SRGB_BLOCK:
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+    case VK_FORMAT_BC5_UNORM_BLOCK:
+    case VK_FORMAT_BC5_SNORM_BLOCK:
+    case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+    case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
+} // namespace
+
+VkDeviceSize ktx2ImageSize(VkFormat format, uint32_t width, uint32_t height) {
+    if (format == VK_FORMAT_R8G8B8A8_UNORM || format == VK_FORMAT_R8G8B8A8_SRGB) {
+        return static_cast<VkDeviceSize>(width) * height * 4;
+    }
+    uint32_t blockSize = bcBlockSize(format);
+    return static_cast<VkDeviceSize>((width + 3) / 4) * ((height + 3) / 4) * blockSize;
+}
+
+Ktx2File::Ktx2File()
+    : filename()
+    , mapping(nullptr)
+    , mappingSize(0)
+    , format(VK_FORMAT_UNDEFINED)
+    , levels()
+{}
+
+Ktx2File::~Ktx2File() {
+    close();
+}
+
+void Ktx2File::open(const std::string& filename) {
+    close();
+    this->filename = filename;
+
+    int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("failed to open " + filename + "!");
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size < static_cast<off_t>(KTX2_HEADER_SIZE)) {
+        ::close(fd);
+        throw std::runtime_error(filename + " is not a KTX2 file!");
+    }
+    mappingSize = static_cast<size_t>(fileStat.st_size);
+    void* memory = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping keeps the file open
+    if (memory == MAP_FAILED) {
+        throw std::runtime_error("failed to map " + filename + "!");
+    }
+    mapping = static_cast<std::byte*>(memory);
+
+    try {
+        if (std::memcmp(mapping, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0) {
+            throw std::runtime_error(filename + " is not a KTX2 file!");
+        }
+
+        format = static_cast<VkFormat>(readField<uint32_t>(mapping, 12));
+        uint32_t width = readField<uint32_t>(mapping, 20);
+        uint32_t height = readField<uint32_t>(mapping, 24);
+        uint32_t depth = readField<uint32_t>(mapping, 28);
+        uint32_t layerCount = readField<uint32_t>(mapping, 32);
+        uint32_t faceCount = readField<uint32_t>(mapping, 36);
+        uint32_t levelCount = std::max(readField<uint32_t>(mapping, 40), 1u); // 0 asks the loader to generate mips
+        uint32_t supercompression = readField<uint32_t>(mapping, 44);
+
+        if (ktx2ImageSize(format, 1, 1) == 0) {
+            throw std::runtime_error(filename + " has an unsupported format (only BCn and RGBA8 are)!");
+        }
+        if (width == 0 || height == 0 || depth > 1 || layerCount > 1 || faceCount != 1) {
+            throw std::runtime_error(filename + " is not a plain 2D texture!");
+        }
+        if (supercompression != 0) {
+            throw std::runtime_error(filename + " is supercompressed, which is not supported!");
+        }
+        if (levelCount > 32 || KTX2_HEADER_SIZE + levelCount * KTX2_LEVEL_INDEX_ENTRY_SIZE > mappingSize) {
+            throw std::runtime_error(filename + " has a broken level index!");
+        }
+
+        levels.reserve(levelCount);
+        for (uint32_t level = 0; level < levelCount; level++) {
+            const std::byte* entry = mapping + KTX2_HEADER_SIZE + level * KTX2_LEVEL_INDEX_ENTRY_SIZE;
+            uint64_t offset = readField<uint64_t>(entry, 0);
+            uint64_t size = readField<uint64_t>(entry, 8);
+
+            uint32_t levelWidth = std::max(width >> level, 1u);
+            uint32_t levelHeight = std::max(height >> level, 1u);
+            if (size != ktx2ImageSize(format, levelWidth, levelHeight) || offset > mappingSize || size > mappingSize - offset) {
+                throw std::runtime_error(filename + " has a broken level " + std::to_string(level) + "!");
+            }
+            levels.emplace_back(offset, size, levelWidth, levelHeight);
+        }
+    } catch (...) {
+        close();
+        throw;
+    }
+}
+
+void Ktx2File::close() {
+    if (mapping != nullptr) {
+        munmap(mapping, mappingSize);
+    }
+    mapping = nullptr;
+    mappingSize = 0;
+    format = VK_FORMAT_UNDEFINED;
+    levels.clear();
+}
+
+void Ktx2File::prefetchLevel(uint32_t level) const {
+    // madvise() wants a page aligned start.
+    size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t start = static_cast<size_t>(levels[level].offset) / pageSize * pageSize;
+    size_t end = static_cast<size_t>(levels[level].offset + levels[level].size);
+    madvise(mapping + start, end - start, MADV_WILLNEED);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One mip level of a texture file, level 0 being the full resolution one.
+struct Ktx2Level {
+    uint64_t offset; // from the start of the file
+    uint64_t size;
+    uint32_t width;
+    uint32_t height;
+    Ktx2Level(uint64_t offset = 0, uint64_t size = 0, uint32_t width = 0, uint32_t height = 0)
+        : offset(offset)
+        , size(size)
+        , width(width)
+        , height(height)
+    {}
+};
+
+// A KTX2 texture file, memory mapped read-only for as long as it is open. Opening only
+// parses the header and the level index; the level data is paged in by whichever thread
+// first touches getLevelData(), so reading it never blocks the thread that opened it.
+//
+// Supported are 2D textures (one layer, one face) without supercompression whose vkFormat
+// is block compressed (BC1 to BC7) or 8-bit RGBA. Basis Universal and zstd supercompressed
+// files are rejected.
+class Ktx2File {
+public:
+    Ktx2File();
+    ~Ktx2File();
+
+    Ktx2File(const Ktx2File& source) = delete;
+    Ktx2File& operator=(const Ktx2File& source) = delete;
+
+    void open(const std::string& filename);
+    void close();
+    bool isOpen() const { return mapping != nullptr; }
+
+    const std::string& getFilename() const { return filename; }
+    VkFormat getFormat() const { return format; }
+    uint32_t getLevelCount() const { return static_cast<uint32_t>(levels.size()); }
+    const Ktx2Level& getLevel(uint32_t level) const { return levels[level]; }
+    const std::byte* getLevelData(uint32_t level) const { return mapping + levels[level].offset; }
+
+    // Asks the kernel to start reading the level from disk in the background.
+    void prefetchLevel(uint32_t level) const;
+
+private:
+    std::string filename;
+    std::byte* mapping;
+    size_t mappingSize;
+    VkFormat format;
+    std::vector<Ktx2Level> levels;
+};
+
+// Size of a tightly packed width x height image in format, 0 if the format is not one
+// Ktx2File supports.
+VkDeviceSize ktx2ImageSize(VkFormat format, uint32_t width, uint32_t height);
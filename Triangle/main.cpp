@@ -1,6 +1,18 @@
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
+#include "render_graph.hpp"
+#include "frame_capture.hpp"
+#include "triple_buffer.hpp"
+#include "frame_pacer.hpp"
+#include "resolution_scaler.hpp"
+#include "host_allocator.hpp"
+#include "allocation_audit.hpp"
+#include "texture_streamer.hpp"
+#include "mesh_loader.hpp"
+#include "debug_message_log.hpp"
+#include "vulkan_memory.hpp"
+
 #include <iostream>
 #include <fstream>
 #include <stdexcept>
@@ -12,6 +24,15 @@
 #include <limits>
 #include <optional>
 #include <set>
+#include <string>
+#include <chrono>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <exception>
+#include <filesystem>
+#include <memory>
+#include <thread>
 
 // Window dimensions
 const uint32_t WIDTH = 800;
@@ -28,11 +49,23 @@ const std::vector<const char*> deviceExtensions = {
 };
 
 #ifdef NDEBUG
-const bool enableValidationLayers = false;
+const ValidationMode DEFAULT_VALIDATION_MODE = ValidationMode::Off;
 #else
-const bool enableValidationLayers = true;
+const ValidationMode DEFAULT_VALIDATION_MODE = ValidationMode::Full;
 #endif
 
+// --validation sync: synchronization validation on, every other check the layer can skip off.
+const std::vector<VkValidationFeatureEnableEXT> syncValidationEnables = {
+    VK_VALIDATION_FEATURE_ENABLE_SYNCHRONIZATION_VALIDATION_EXT
+};
+const std::vector<VkValidationFeatureDisableEXT> syncValidationDisables = {
+    VK_VALIDATION_FEATURE_DISABLE_SHADERS_EXT,
+    VK_VALIDATION_FEATURE_DISABLE_THREAD_SAFETY_EXT,
+    VK_VALIDATION_FEATURE_DISABLE_API_PARAMETERS_EXT,
+    VK_VALIDATION_FEATURE_DISABLE_OBJECT_LIFETIMES_EXT,
+    VK_VALIDATION_FEATURE_DISABLE_CORE_CHECKS_EXT
+};
+
 VkResult CreateDebugUtilsMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugUtilsMessengerEXT* pDebugMessenger) {
     auto func = (PFN_vkCreateDebugUtilsMessengerEXT) vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
     if (func != nullptr) {
@@ -49,16 +82,30 @@ void DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT
     }
 }
 
+// Queue priorities handed to vkCreateDevice. When several roles end up on the
+// same family the highest priority of those roles is used.
+const float GRAPHICS_QUEUE_PRIORITY = 1.0f;
+const float COMPUTE_QUEUE_PRIORITY = 0.75f;
+const float TRANSFER_QUEUE_PRIORITY = 0.5f;
+
 struct QueueFamilyIndices {
     std::optional<uint32_t> graphicsFamily;
     std::optional<uint32_t> presentFamily;
-    QueueFamilyIndices(std::optional<uint32_t> graphicsFamily = std::nullopt, std::optional<uint32_t> presentFamily = std::nullopt)
+    std::optional<uint32_t> computeFamily; // compute-only family if there is one, else the graphics one if it has compute
+    std::optional<uint32_t> transferFamily; // transfer-only family if there is one, else the best fallback
+    QueueFamilyIndices(
+        std::optional<uint32_t> graphicsFamily = std::nullopt,
+        std::optional<uint32_t> presentFamily = std::nullopt,
+        std::optional<uint32_t> computeFamily = std::nullopt,
+        std::optional<uint32_t> transferFamily = std::nullopt)
         : graphicsFamily(graphicsFamily)
         , presentFamily(presentFamily)
+        , computeFamily(computeFamily)
+        , transferFamily(transferFamily)
     {}
 
     bool isComplete() {
-        return graphicsFamily.has_value() && presentFamily.has_value();
+        return graphicsFamily.has_value() && presentFamily.has_value() && computeFamily.has_value();
     }
 };
 
@@ -75,30 +122,376 @@ struct SwapChainSupportDetails {
         , presentModes(presentModes) {}
 };
 
+// Most windows the application renders to at once.
+const uint32_t MAX_WINDOWS = 16;
+
+// --compute-overlay: an OVERLAY_SIZE square that the async compute queue draws every
+// frame, blitted OVERLAY_MARGIN pixels from the top left corner of each window.
+const uint32_t OVERLAY_SIZE = 128;
+const int32_t OVERLAY_MARGIN = 16;
+const uint32_t OVERLAY_GROUP_SIZE = 8; // local size of shaders/overlay.comp
+const VkFormat OVERLAY_FORMAT = VK_FORMAT_R8G8B8A8_UNORM; // rgba8 in shaders/overlay.comp
+
+// Storage image the overlay compute pass writes, bound to its descriptor set.
+struct OverlayImage {
+    VkImage image;
+    VkDeviceMemory memory;
+    VkImageView view;
+    VkDescriptorSet descriptorSet;
+    OverlayImage(
+        VkImage image = VK_NULL_HANDLE,
+        VkDeviceMemory memory = VK_NULL_HANDLE,
+        VkImageView view = VK_NULL_HANDLE,
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE)
+        : image(image)
+        , memory(memory)
+        , view(view)
+        , descriptorSet(descriptorSet)
+    {}
+};
+
+// A window (or headless surface) with its swapchain and everything sized after it. All
+// targets share the device, pipeline and per-frame command buffer: a frame records every
+// target into one submission and presents them with a single vkQueuePresentKHR.
+struct PresentTarget {
+    uint32_t index; // target 0 is the primary one, frame capture reads it back
+    GLFWwindow* window;
+    VkSurfaceKHR surface;
+
+    SwapChainSupportDetails swapChainSupport; // last querySwapChainSupport() result
+    VkSwapchainKHR swapChain;
+    std::vector<VkImage> swapChainImages;
+    VkExtent2D swapChainExtent;
+    std::vector<VkImageView> swapChainImageViews;
+    std::vector<VkFramebuffer> swapChainFramebuffers;
+    uint64_t firstPresentId; // present ids below this went to an older swapchain
+
+    RenderGraph frameGraph;
+    RenderGraphResource backbuffer;
+    RenderGraphResource sceneColor; // offscreen target of scaled rendering, == backbuffer without it
+    RenderGraphResource colorTarget; // multisampled color, resolved into sceneColor (== sceneColor without MSAA)
+    RenderGraphResource depthBuffer;
+    RenderGraphResource overlay; // bound to overlayImages[currentFrame] every frame
+    VkExtent2D renderExtent;
+    VkFilter upscaleFilter;
+
+    // --compute-overlay. One per frame in flight, so a frame's dispatch never overwrites
+    // the image the previous frame may still be blitting from.
+    std::array<OverlayImage, MAX_FRAMES_IN_FLIGHT> overlayImages;
+
+    std::array<VkSemaphore, MAX_FRAMES_IN_FLIGHT> imageAvailableSemaphores;
+    uint32_t imageIndex; // acquired for the frame being recorded
+    bool swapChainStale; // recreation was put off while the window was minimized
+
+    // Written by the GLFW callbacks on the main thread, read by the render thread.
+    std::atomic<bool> framebufferResized;
+    std::atomic<int> framebufferWidth;
+    std::atomic<int> framebufferHeight;
+
+    PresentTarget(uint32_t index = 0)
+        : index(index)
+        , window(nullptr)
+        , surface(VK_NULL_HANDLE)
+        , swapChainSupport()
+        , swapChain(VK_NULL_HANDLE)
+        , swapChainImages()
+        , swapChainExtent()
+        , swapChainImageViews()
+        , swapChainFramebuffers()
+        , firstPresentId(1)
+        , frameGraph()
+        , backbuffer(0)
+        , sceneColor(0)
+        , colorTarget(0)
+        , depthBuffer(0)
+        , overlay(0)
+        , renderExtent()
+        , upscaleFilter(VK_FILTER_LINEAR)
+        , overlayImages()
+        , imageAvailableSemaphores()
+        , imageIndex(0)
+        , swapChainStale(false)
+        , framebufferResized(false)
+        , framebufferWidth(0)
+        , framebufferHeight(0)
+    {}
+
+    PresentTarget(const PresentTarget& source) = delete;
+    PresentTarget& operator=(const PresentTarget& source) = delete;
+};
+
+// Command line options, see printUsage().
+struct AppOptions {
+    bool forceRenderPass; // use VkRenderPass/VkFramebuffer even where dynamic rendering is available
+    uint32_t resizeBenchmarkCount; // recreate the swapchain this many times at startup and report the cost
+    uint32_t msaaSamples; // requested sample count, lowered to what the device supports
+    std::string captureDirectory; // write every presented frame here, empty to disable
+    CaptureFileFormat captureFormat;
+    std::optional<uint64_t> captureFrame; // capture only this frame
+    bool headless; // render through VK_EXT_headless_surface without a window
+    uint64_t frameCount; // exit after this many frames, 0 to run until the window is closed
+    std::string statsFile; // write frame time statistics here at exit
+    std::optional<double> targetFrameRate; // 0 for unlimited, default is the monitor refresh rate
+    double renderScale; // fraction of the swapchain resolution to render at (upper bound with gpuBudgetMs)
+    double gpuBudgetMs; // adapt the render scale to keep GPU time under this, 0 to disable
+    std::string resolutionHistoryFile; // write the render scale history here at exit
+    uint32_t windowCount; // windows (or headless surfaces) to render to, each with its own swapchain
+    std::string textureDirectory; // stream every .ktx2 texture in here, empty to disable
+    uint64_t textureBudgetMiB; // cap on texture memory on top of the device's budget, 0 for none
+    std::string meshFile; // .mesh file (written by tools/meshconv) to load into device memory
+    bool computeOverlay; // draw an overlay on the async compute queue and blit it into every window
+    ValidationMode validationMode;
+    VkDebugUtilsMessageSeverityFlagBitsEXT validationSeverity; // least severe validation message logged
+    AppOptions(
+        bool forceRenderPass = false,
+        uint32_t resizeBenchmarkCount = 0,
+        uint32_t msaaSamples = 1,
+        std::string captureDirectory = "",
+        CaptureFileFormat captureFormat = CaptureFileFormat::Png,
+        std::optional<uint64_t> captureFrame = std::nullopt,
+        bool headless = false,
+        uint64_t frameCount = 0,
+        std::string statsFile = "",
+        std::optional<double> targetFrameRate = std::nullopt,
+        double renderScale = 1.0,
+        double gpuBudgetMs = 0.0,
+        std::string resolutionHistoryFile = "",
+        uint32_t windowCount = 1,
+        std::string textureDirectory = "",
+        uint64_t textureBudgetMiB = 0,
+        std::string meshFile = "",
+        bool computeOverlay = false,
+        ValidationMode validationMode = DEFAULT_VALIDATION_MODE,
+        VkDebugUtilsMessageSeverityFlagBitsEXT validationSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT)
+        : forceRenderPass(forceRenderPass)
+        , resizeBenchmarkCount(resizeBenchmarkCount)
+        , msaaSamples(msaaSamples)
+        , captureDirectory(captureDirectory)
+        , captureFormat(captureFormat)
+        , captureFrame(captureFrame)
+        , headless(headless)
+        , frameCount(frameCount)
+        , statsFile(statsFile)
+        , targetFrameRate(targetFrameRate)
+        , renderScale(renderScale)
+        , gpuBudgetMs(gpuBudgetMs)
+        , resolutionHistoryFile(resolutionHistoryFile)
+        , windowCount(windowCount)
+        , textureDirectory(textureDirectory)
+        , textureBudgetMiB(textureBudgetMiB)
+        , meshFile(meshFile)
+        , computeOverlay(computeOverlay)
+        , validationMode(validationMode)
+        , validationSeverity(validationSeverity)
+    {}
+};
+
+void printUsage(const char* program) {
+    std::cout << "usage: " << program << " [options]\n"
+              << "  --render-pass          use the VkRenderPass path even if dynamic rendering is supported\n"
+              << "  --resize-benchmark N   recreate the swapchain N times at startup and print the cost\n"
+              << "  --msaa N               multisample with N samples per pixel (default 1)\n"
+              << "  --capture DIR          write the rendered frames to DIR\n"
+              << "  --capture-format FMT   png (default) or raw\n"
+              << "  --capture-frame N      only capture frame N (counting from 0)\n"
+              << "  --headless             render without a window (VK_EXT_headless_surface)\n"
+              << "  --frames N             exit after N frames (required with --headless)\n"
+              << "  --stats FILE           write frame time statistics to FILE at exit\n"
+              << "  --fps N                limit the frame rate to N, 0 for unlimited (default: monitor refresh rate)\n"
+              << "  --render-scale S       render at S (0..1] of the window resolution and upscale\n"
+              << "  --dynamic-resolution MS  lower the render scale while GPU frame time exceeds MS\n"
+              << "  --resolution-history FILE  write the GPU time and render scale history as CSV at exit\n"
+              << "  --windows N            render to N windows at once, presented together (default 1)\n"
+              << "  --textures DIR         stream the .ktx2 textures (BCn or RGBA8) in DIR into device memory\n"
+              << "  --texture-budget MB    keep streamed textures below MB of device memory\n"
+              << "  --mesh FILE            load FILE (converted with tools/meshconv) into device memory\n"
+              << "  --compute-overlay      draw an overlay on the async compute queue and blit it into every window\n"
+              << "  --validation MODE      full, sync (synchronization validation only) or off\n"
+              << "                         (default: full in debug builds, off in release builds)\n"
+              << "  --validation-severity S  log validation messages from S up: verbose, info, warning (default) or error\n";
+}
+
+AppOptions parseOptions(int argc, char** argv) {
+    AppOptions options;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--render-pass") {
+            options.forceRenderPass = true;
+        } else if (arg == "--resize-benchmark" && i + 1 < argc) {
+            options.resizeBenchmarkCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--msaa" && i + 1 < argc) {
+            options.msaaSamples = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--capture" && i + 1 < argc) {
+            options.captureDirectory = argv[++i];
+        } else if (arg == "--capture-format" && i + 1 < argc) {
+            std::string format = argv[++i];
+            if (format == "png") {
+                options.captureFormat = CaptureFileFormat::Png;
+            } else if (format == "raw") {
+                options.captureFormat = CaptureFileFormat::Raw;
+            } else {
+                throw std::runtime_error("unknown capture format: " + format);
+            }
+        } else if (arg == "--capture-frame" && i + 1 < argc) {
+            options.captureFrame = std::stoull(argv[++i]);
+        } else if (arg == "--headless") {
+            options.headless = true;
+        } else if (arg == "--frames" && i + 1 < argc) {
+            options.frameCount = std::stoull(argv[++i]);
+        } else if (arg == "--stats" && i + 1 < argc) {
+            options.statsFile = argv[++i];
+        } else if (arg == "--fps" && i + 1 < argc) {
+            options.targetFrameRate = std::stod(argv[++i]);
+        } else if (arg == "--render-scale" && i + 1 < argc) {
+            options.renderScale = std::stod(argv[++i]);
+        } else if (arg == "--dynamic-resolution" && i + 1 < argc) {
+            options.gpuBudgetMs = std::stod(argv[++i]);
+        } else if (arg == "--resolution-history" && i + 1 < argc) {
+            options.resolutionHistoryFile = argv[++i];
+        } else if (arg == "--windows" && i + 1 < argc) {
+            options.windowCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--textures" && i + 1 < argc) {
+            options.textureDirectory = argv[++i];
+        } else if (arg == "--texture-budget" && i + 1 < argc) {
+            options.textureBudgetMiB = std::stoull(argv[++i]);
+        } else if (arg == "--mesh" && i + 1 < argc) {
+            options.meshFile = argv[++i];
+        } else if (arg == "--compute-overlay") {
+            options.computeOverlay = true;
+        } else if (arg == "--validation" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode == "full") {
+                options.validationMode = ValidationMode::Full;
+            } else if (mode == "sync") {
+                options.validationMode = ValidationMode::Synchronization;
+            } else if (mode == "off") {
+                options.validationMode = ValidationMode::Off;
+            } else {
+                throw std::runtime_error("unknown validation mode: " + mode);
+            }
+        } else if (arg == "--validation-severity" && i + 1 < argc) {
+            std::string severity = argv[++i];
+            if (severity == "verbose") {
+                options.validationSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT;
+            } else if (severity == "info") {
+                options.validationSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT;
+            } else if (severity == "warning") {
+                options.validationSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT;
+            } else if (severity == "error") {
+                options.validationSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+            } else {
+                throw std::runtime_error("unknown validation severity: " + severity);
+            }
+        } else if (arg == "--help" || arg == "-h") {
+            printUsage(argv[0]);
+            std::exit(EXIT_SUCCESS);
+        } else {
+            printUsage(argv[0]);
+            throw std::runtime_error("unknown option: " + arg);
+        }
+    }
+
+    if (options.headless && options.frameCount == 0) {
+        throw std::runtime_error("--headless needs --frames, there is no window to close!");
+    }
+    if (options.windowCount == 0 || options.windowCount > MAX_WINDOWS) {
+        throw std::runtime_error("--windows must be between 1 and " + std::to_string(MAX_WINDOWS) + "!");
+    }
+
+    return options;
+}
+
+// Time spent in recreateSwapChain() after the device went idle.
+struct ResizeStats {
+    uint32_t count;
+    double totalMs;
+    double maxMs;
+    ResizeStats(uint32_t count = 0, double totalMs = 0.0, double maxMs = 0.0)
+        : count(count)
+        , totalMs(totalMs)
+        , maxMs(maxMs)
+    {}
+};
+
+// Rate of the simulation thread. Rendering runs at its own rate and always picks up the
+// latest snapshot the simulation has published.
+const double SIMULATION_RATE_HZ = 120.0;
+
+// Everything the render thread needs from the simulation for one frame. The simulation
+// thread fills it in and publishes it; after that it is never modified.
+struct FrameSnapshot {
+    uint64_t tick;
+    double time; // seconds of simulated time
+    std::array<float, 4> clearColor;
+    FrameSnapshot(uint64_t tick = 0, double time = 0.0, std::array<float, 4> clearColor = {0.0f, 0.0f, 0.0f, 1.0f})
+        : tick(tick)
+        , time(time)
+        , clearColor(clearColor)
+    {}
+};
+
+// How many presented frames may be queued behind the one the display is showing
+// before the render thread waits (VK_KHR_present_wait), and how long it waits at most.
+const uint64_t PRESENT_WAIT_FRAME_LAG = 1;
+const uint64_t PRESENT_WAIT_TIMEOUT_NS = 100'000'000;
+
+// Lowest render scale dynamic resolution may pick.
+const double MIN_RENDER_SCALE = 0.5;
+
+// Frames rendered at startup that are left out of the frame time statistics
+// (pipeline warm-up, first swapchain images, lazy driver initialization).
+const size_t FRAME_STATS_WARMUP = 3;
+
+// From this frame on, builds with the allocation audit fail on any heap allocation our
+// code makes during a frame, except in frames that recreate the swapchain.
+const uint64_t STEADY_STATE_FIRST_FRAME = 3;
+
 class HelloTriangleApplication {
 public:
-    HelloTriangleApplication()
-        : window()
+    HelloTriangleApplication(const AppOptions& options = AppOptions())
+        : options(options)
+        , hostAllocator()
         , instance(VK_NULL_HANDLE)
         , debugMessenger(VK_NULL_HANDLE)
-        , surface(VK_NULL_HANDLE)
+        , debugMessageLog()
+        , targets()
         , device(VK_NULL_HANDLE)
         , graphicsQueue(VK_NULL_HANDLE)
         , presentQueue(VK_NULL_HANDLE)
-        , swapChain(VK_NULL_HANDLE)
-        , swapChainImages()
+        , computeQueue(VK_NULL_HANDLE)
+        , transferQueue(VK_NULL_HANDLE)
+        , deviceSwapChainSupport()
         , swapChainImageFormat()
-        , swapChainExtent()
-        , swapChainImageViews()
-        , swapChainFramebuffers()
+        , swapChainColorSpace()
         , renderPass()
         , pipelineLayout()
         , graphicsPipeline()
+        , overlayDescriptorSetLayout(VK_NULL_HANDLE)
+        , overlayDescriptorPool(VK_NULL_HANDLE)
+        , overlayPipelineLayout(VK_NULL_HANDLE)
+        , overlayPipeline(VK_NULL_HANDLE)
+        , frameCapture()
+        , textureStreamer()
+        , mesh()
         , commandPool()
         , commandBuffers()
-        , imageAvailableSemaphores()
+        , computeCommandPool()
+        , computeCommandBuffers()
+        , transferCommandPool()
         , renderFinishedSemaphores()
+        , computeFinishedSemaphores()
         , inFlightFences()
+        , resizeStats()
+        , frameTimesMs()
+        , frameAllocationAudit()
+        , snapshots()
+        , framePacer()
+        , resolutionScaler()
+        , timestampsPending()
+        , running(false)
+        , renderError()
+        , simulationError()
     {}
 
     HelloTriangleApplication(const HelloTriangleApplication& source);
@@ -107,141 +500,497 @@ public:
     void run() {
         initWindow();
         initVulkan();
+        if (options.resizeBenchmarkCount > 0) {
+            benchmarkResize(options.resizeBenchmarkCount);
+        }
         mainLoop();
+        framePacer.printSummary(std::cout);
+        if (useScaledRendering) {
+            resolutionScaler.printSummary(std::cout);
+        }
+        if (!options.resolutionHistoryFile.empty()) {
+            resolutionScaler.writeHistory(options.resolutionHistoryFile);
+        }
+        printResizeStats();
+        writeFrameStats();
+        if (useTextureStreaming) {
+            textureStreamer.printSummary(std::cout);
+        }
         cleanup();
+        hostAllocator.printSummary(std::cout);
+        if (enableValidationLayers) {
+            debugMessageLog.printSummary(std::cout);
+        }
     }
 
 private:
-    GLFWwindow* window;
+    AppOptions options;
+
+    // Host memory for every Vulkan object; declared first so it outlives them all.
+    HostAllocator hostAllocator;
+    const VkAllocationCallbacks* allocator = hostAllocator.getCallbacks();
 
     VkInstance instance;
     VkDebugUtilsMessengerEXT debugMessenger;
-    VkSurfaceKHR surface;
+    bool enableValidationLayers = false; // options.validationMode is not Off
+    DebugMessageLog debugMessageLog;
+    std::vector<std::unique_ptr<PresentTarget>> targets; // options.windowCount of them, fixed after initWindow()
+
+    uint32_t instanceApiVersion = VK_API_VERSION_1_0;
 
     VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
     VkDevice device;
 
+    // VK_KHR_dynamic_rendering (core in 1.3) replaces renderPass/swapChainFramebuffers when available.
+    bool useDynamicRendering = false;
+    bool dynamicRenderingIsCore = false;
+    PFN_vkCmdBeginRenderingKHR cmdBeginRendering = nullptr;
+    PFN_vkCmdEndRenderingKHR cmdEndRendering = nullptr;
+
+    // VK_KHR_present_id + VK_KHR_present_wait: every present carries an id and the render
+    // thread can wait until a given one is on screen.
+    bool usePresentWait = false;
+    PFN_vkWaitForPresentKHR waitForPresent = nullptr;
+    uint64_t presentId = 0; // id of the last present, shared by all swapchains presented with it
+    PresentTarget* pacingTarget = nullptr; // first target of the last present
+
     VkQueue graphicsQueue;
     VkQueue presentQueue;
+    VkQueue computeQueue;
+    VkQueue transferQueue; // staging copies: the mesh, and the texture streamer's
 
-    VkSwapchainKHR swapChain;
-    std::vector<VkImage> swapChainImages;
+    SwapChainSupportDetails deviceSwapChainSupport; // scratch for isDeviceSuitable()
+    // Of every swapchain, picked once at startup; the render pass and pipeline are built for it.
     VkFormat swapChainImageFormat;
-    VkExtent2D swapChainExtent;
-    std::vector<VkImageView> swapChainImageViews;
-    std::vector<VkFramebuffer> swapChainFramebuffers;
+    VkColorSpaceKHR swapChainColorSpace;
 
     VkRenderPass renderPass;
     VkPipelineLayout pipelineLayout;
     VkPipeline graphicsPipeline;
 
+    // --compute-overlay, see createComputeOverlay().
+    VkDescriptorSetLayout overlayDescriptorSetLayout;
+    VkDescriptorPool overlayDescriptorPool;
+    VkPipelineLayout overlayPipelineLayout;
+    VkPipeline overlayPipeline;
+
+    FrameCapture frameCapture;
+
+    // --textures only streams the files in and out against the memory budget; no pass
+    // samples them (TextureStreamer::getView() and getSampler() are for the passes that will).
+    bool useTextureStreaming = false;
+    bool useMemoryBudget = false; // VK_EXT_memory_budget
+    TextureStreamer textureStreamer;
+
+    // Nothing draws the mesh yet; it is loaded to measure the load path.
+    GpuMesh mesh;
+
+    VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;
+    VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+
     VkCommandPool commandPool;
     std::vector<VkCommandBuffer> commandBuffers;
 
-    std::vector<VkSemaphore> imageAvailableSemaphores;
+    VkCommandPool computeCommandPool;
+    std::vector<VkCommandBuffer> computeCommandBuffers;
+
+    VkCommandPool transferCommandPool;
+
     std::vector<VkSemaphore> renderFinishedSemaphores;
+    std::vector<VkSemaphore> computeFinishedSemaphores;
     std::vector<VkFence> inFlightFences;
     uint32_t currentFrame = 0;
 
-    bool framebufferResized = false;
+    ResizeStats resizeStats;
+
+    uint64_t framesRendered = 0;
+    std::vector<double> frameTimesMs; // drawFrame() wall time, for --stats
+    AllocationAudit frameAllocationAudit;
+
+    TripleBuffer<FrameSnapshot> snapshots; // simulation thread -> render thread
+    FramePacer framePacer;
+
+    // Dynamic resolution: the scene is rendered into the top left renderExtent of each
+    // target's sceneColor, an offscreen image as large as the swapchain, and blitted up to
+    // the backbuffer. Changing the scale never reallocates anything.
+    bool useScaledRendering = false;
+    ResolutionScaler resolutionScaler;
+
+    // Two timestamps per frame in flight around the frame's command buffer.
+    bool useGpuTimestamps = false;
+    VkQueryPool timestampPool = VK_NULL_HANDLE;
+    std::array<bool, MAX_FRAMES_IN_FLIGHT> timestampsPending;
+    double timestampPeriodNs = 1.0;
+    uint64_t timestampMask = ~0ull;
+    std::atomic<bool> running;
+    std::exception_ptr renderError;
+    std::exception_ptr simulationError;
 
     void initWindow() {
+        targets.reserve(options.windowCount);
+        for (uint32_t i = 0; i < options.windowCount; i++) {
+            targets.push_back(std::make_unique<PresentTarget>(i));
+        }
+
+        if (options.headless) {
+            return;
+        }
+
         glfwInit();
 
         glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
 
-        window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
-        glfwSetWindowUserPointer(window, this);
-        glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+        for (auto& target : targets) {
+            std::string title = target->index == 0 ? "Vulkan" : "Vulkan " + std::to_string(target->index + 1);
+            target->window = glfwCreateWindow(WIDTH, HEIGHT, title.c_str(), nullptr, nullptr);
+            glfwSetWindowUserPointer(target->window, target.get());
+            glfwSetFramebufferSizeCallback(target->window, framebufferResizeCallback);
+
+            int width, height;
+            glfwGetFramebufferSize(target->window, &width, &height);
+            target->framebufferWidth = width;
+            target->framebufferHeight = height;
+        }
+
+        // Rendering faster than the display refreshes only produces frames nobody sees.
+        if (!options.targetFrameRate.has_value()) {
+            GLFWmonitor* monitor = glfwGetPrimaryMonitor();
+            const GLFWvidmode* mode = monitor != nullptr ? glfwGetVideoMode(monitor) : nullptr;
+            framePacer.setTargetRate(mode != nullptr ? mode->refreshRate : 0.0);
+        }
     }
 
-    static void framebufferResizeCallback(GLFWwindow* window, [[maybe_unused]] int width, [[maybe_unused]] int height) {
-        auto app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
-        app->framebufferResized = true;
+    static void framebufferResizeCallback(GLFWwindow* window, int width, int height) {
+        auto target = reinterpret_cast<PresentTarget*>(glfwGetWindowUserPointer(window));
+        target->framebufferWidth = width;
+        target->framebufferHeight = height;
+        target->framebufferResized = true;
     }
 
     void initVulkan() {
+        enableValidationLayers = options.validationMode != ValidationMode::Off;
+        if (enableValidationLayers) {
+            debugMessageLog.setMinimumSeverity(options.validationSeverity);
+            debugMessageLog.start(std::cerr);
+        }
+
+        if (options.targetFrameRate.has_value()) {
+            framePacer.setTargetRate(options.targetFrameRate.value());
+        }
+
         createInstance(); // Initializing Vulkan library
         setupDebugMessenger(); // Validation Layer
-        createSurface();
+        createSurfaces();
         pickPhysicalDevice(); // find, check, pick GPU
         createLogicalDevice();
-        createSwapChain();
-        createImageViews();
+        if (!options.captureDirectory.empty()) {
+            frameCapture.start(options.captureDirectory, options.captureFormat, MAX_FRAMES_IN_FLIGHT);
+            frameCapture.selectFrame(options.captureFrame);
+        }
+        chooseSwapSurfaceFormat();
+        for (auto& target : targets) {
+            createSwapChain(*target);
+            createImageViews(*target);
+        }
         createRenderPass();
         createGraphicsPipeline();
-        createFramebuffers();
+        if (options.computeOverlay) {
+            createComputeOverlay();
+        }
+        for (auto& target : targets) {
+            createFrameGraph(*target);
+            createFramebuffers(*target);
+        }
         createCommandPool();
         createCommandBuffers();
         createSyncObjects();
+        createTimestampQueries();
+        if (useTextureStreaming) {
+            createTextures();
+        }
+        if (!options.meshFile.empty()) {
+            createMesh();
+        }
     }
 
+    // The main thread only handles window events (GLFW wants them on the main thread).
+    // Simulation and rendering run on their own threads and only meet in the snapshots
+    // triple buffer, so neither a slow simulation step nor a fence wait blocks the other
+    // or input handling.
     void mainLoop() {
-        while (!glfwWindowShouldClose(window)) {
-            glfwPollEvents();
-            drawFrame();
+        running = true;
+        std::thread simulationThread(&HelloTriangleApplication::simulationLoop, this);
+        std::thread renderThread(&HelloTriangleApplication::renderLoop, this);
+
+        if (!options.headless) {
+            // Closing any of the windows ends the program.
+            while (running && std::none_of(targets.begin(), targets.end(), [](const auto& target) { return glfwWindowShouldClose(target->window); })) {
+                glfwWaitEvents();
+            }
+            running = false;
         }
 
+        renderThread.join(); // headless runs end after options.frameCount frames
+        running = false;
+        simulationThread.join();
+
         vkDeviceWaitIdle(device);
+
+        if (renderError) {
+            std::rethrow_exception(renderError);
+        }
+        if (simulationError) {
+            std::rethrow_exception(simulationError);
+        }
+    }
+
+    void simulationLoop() {
+        try {
+            const auto step = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / SIMULATION_RATE_HZ));
+            auto nextTick = std::chrono::steady_clock::now();
+
+            for (uint64_t tick = 0; running; tick++) {
+                // Headless runs render fixed scenes, so their clock stands still.
+                double time = options.headless ? 0.0 : static_cast<double>(tick) / SIMULATION_RATE_HZ;
+                simulate(snapshots.writeBuffer(), tick, time);
+                snapshots.publish();
+
+                nextTick += step;
+                std::this_thread::sleep_until(nextTick);
+            }
+        } catch (...) {
+            simulationError = std::current_exception();
+            running = false;
+        }
+    }
+
+    void simulate(FrameSnapshot& snapshot, uint64_t tick, double time) {
+        snapshot.tick = tick;
+        snapshot.time = time;
+
+        // Slowly pulse the background, starting from black.
+        float pulse = static_cast<float>(0.5 - 0.5 * std::cos(time * 0.5));
+        snapshot.clearColor = {0.02f * pulse, 0.03f * pulse, 0.08f * pulse, 1.0f};
+    }
+
+    void renderLoop() {
+        try {
+            if (!options.statsFile.empty()) {
+                frameTimesMs.reserve(options.frameCount > 0 ? options.frameCount : 1 << 16);
+            }
+
+            while (running && (options.frameCount == 0 || framesRendered < options.frameCount)) {
+                bool audited = AllocationAudit::isAvailable() && framesRendered >= STEADY_STATE_FIRST_FRAME;
+                uint32_t resizeCount = resizeStats.count;
+                if (audited) {
+                    frameAllocationAudit.begin();
+                }
+
+                // Start the frame as late as possible: once the display has caught up and the
+                // pacer's deadline has come, then with the newest simulation snapshot.
+                waitForPresentedFrame();
+                framePacer.waitForNextFrame();
+                snapshots.update();
+
+                auto start = std::chrono::steady_clock::now();
+                drawFrame();
+                // Past the reserved capacity the statistics stop growing rather than reallocate.
+                if (!options.statsFile.empty() && frameTimesMs.size() < frameTimesMs.capacity()) {
+                    frameTimesMs.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+                }
+
+                if (audited) {
+                    frameAllocationAudit.end();
+                    checkFrameAllocations(resizeStats.count != resizeCount);
+                }
+            }
+        } catch (...) {
+            frameAllocationAudit.end();
+            renderError = std::current_exception();
+        }
+
+        running = false;
+        if (!options.headless) {
+            glfwPostEmptyEvent(); // wake the main thread out of glfwWaitEvents()
+        }
+    }
+
+    // Allocations in the frame loop show up as frame time spikes, so steady-state frames
+    // must not make any; recreating a swapchain is allowed to.
+    void checkFrameAllocations(bool recreatedSwapChain) {
+        if (recreatedSwapChain || frameAllocationAudit.getAllocationCount() == 0) {
+            return;
+        }
+
+        std::cerr << "frame " << framesRendered << " made " << frameAllocationAudit.getAllocationCount() << " heap allocations:\n";
+        frameAllocationAudit.printCallSites(std::cerr);
+        throw std::runtime_error("heap allocation in a steady-state frame!");
     }
 
-    void cleanupSwapChain() {
-        for (auto framebuffer : swapChainFramebuffers) {
-            vkDestroyFramebuffer(device, framebuffer, nullptr);
+    void cleanupSwapChain(PresentTarget& target) {
+        target.frameGraph.destroy(device, allocator);
+        if (frameCapture.isActive() && target.index == 0) {
+            frameCapture.destroyBuffers(device, allocator);
+        }
+
+        for (auto framebuffer : target.swapChainFramebuffers) {
+            vkDestroyFramebuffer(device, framebuffer, allocator);
         }
+        target.swapChainFramebuffers.clear();
 
-        for (auto imageView : swapChainImageViews) {
-            vkDestroyImageView(device, imageView, nullptr);
+        for (auto imageView : target.swapChainImageViews) {
+            vkDestroyImageView(device, imageView, allocator);
         }
 
-        vkDestroySwapchainKHR(device, swapChain, nullptr);
+        vkDestroySwapchainKHR(device, target.swapChain, allocator);
     }
 
     void cleanup() {
-        cleanupSwapChain();
+        for (auto& target : targets) {
+            cleanupSwapChain(*target);
+        }
+
+        if (frameCapture.isActive()) {
+            frameCapture.stop();
+            frameCapture.printSummary(std::cout);
+        }
 
-        vkDestroyPipeline(device, graphicsPipeline, nullptr);
-        vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+        textureStreamer.destroy();
+        destroyMesh(device, mesh, allocator);
 
-        vkDestroyRenderPass(device, renderPass, nullptr);
+        if (options.computeOverlay) {
+            destroyComputeOverlay();
+        }
+
+        vkDestroyPipeline(device, graphicsPipeline, allocator);
+        vkDestroyPipelineLayout(device, pipelineLayout, allocator);
+
+        vkDestroyRenderPass(device, renderPass, allocator);
 
         for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
-            vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
-            vkDestroyFence(device, inFlightFences[i], nullptr);
+            vkDestroySemaphore(device, renderFinishedSemaphores[i], allocator);
+            vkDestroySemaphore(device, computeFinishedSemaphores[i], allocator);
+            vkDestroyFence(device, inFlightFences[i], allocator);
+            for (auto& target : targets) {
+                vkDestroySemaphore(device, target->imageAvailableSemaphores[i], allocator);
+            }
         }
 
-        vkDestroyCommandPool(device, commandPool, nullptr);
+        if (timestampPool != VK_NULL_HANDLE) {
+            vkDestroyQueryPool(device, timestampPool, allocator);
+        }
+
+        vkDestroyCommandPool(device, transferCommandPool, allocator);
+        vkDestroyCommandPool(device, computeCommandPool, allocator);
+        vkDestroyCommandPool(device, commandPool, allocator);
 
-        vkDestroyDevice(device, nullptr);
+        vkDestroyDevice(device, allocator);
 
         if (enableValidationLayers) {
-            DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
+            DestroyDebugUtilsMessengerEXT(instance, debugMessenger, allocator);
+        }
+
+        for (auto& target : targets) {
+            vkDestroySurfaceKHR(instance, target->surface, allocator);
         }
+        vkDestroyInstance(instance, allocator);
+        debugMessageLog.stop();
 
-        vkDestroySurfaceKHR(instance, surface, nullptr);
-        vkDestroyInstance(instance, nullptr);
+        if (!options.headless) {
+            for (auto& target : targets) {
+                glfwDestroyWindow(target->window);
+            }
+
+            glfwTerminate();
+        }
+    }
 
-        glfwDestroyWindow(window);
+    // All windows are presented in one batch, so waiting on one of them paces them all.
+    // That is the primary window unless it sat the last frame out (e.g. minimized).
+    void waitForPresentedFrame() {
+        if (!usePresentWait || pacingTarget == nullptr || presentId < pacingTarget->firstPresentId + PRESENT_WAIT_FRAME_LAG) {
+            return;
+        }
 
-        glfwTerminate();
+        // VK_TIMEOUT and VK_ERROR_OUT_OF_DATE_KHR are fine here: the wait only paces the
+        // loop, and the next acquire deals with an out of date swapchain.
+        waitForPresent(device, pacingTarget->swapChain, presentId - PRESENT_WAIT_FRAME_LAG, PRESENT_WAIT_TIMEOUT_NS);
     }
 
-    void recreateSwapChain() {
-        int width = 0, height = 0;
-        glfwGetFramebufferSize(window, &width, &height);
-        while (width == 0 || height == 0) {
-            glfwGetFramebufferSize(window, &width, &height);
-            glfwWaitEvents();
+    // Runs on the render thread, which must not call into GLFW and must not wait out a
+    // minimized window either, the other windows still render. Such a target is marked
+    // stale and recreated by the first drawFrame() after the main thread's callback records
+    // a size again.
+    void recreateSwapChain(PresentTarget& target) {
+        if (!options.headless && (target.framebufferWidth == 0 || target.framebufferHeight == 0)) {
+            target.swapChainStale = true;
+            return;
         }
+        target.swapChainStale = false;
 
         vkDeviceWaitIdle(device);
 
-        cleanupSwapChain();
+        auto start = std::chrono::steady_clock::now();
+
+        cleanupSwapChain(target);
+
+        createSwapChain(target);
+        createImageViews(target);
+        createFrameGraph(target);
+        createFramebuffers(target);
+
+        double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        resizeStats.count++;
+        resizeStats.totalMs += elapsedMs;
+        resizeStats.maxMs = std::max(resizeStats.maxMs, elapsedMs);
+    }
+
+    // Forces swapchain recreations so the two rendering paths can be compared
+    // (run once with and once without --render-pass).
+    void benchmarkResize(uint32_t count) {
+        for (uint32_t i = 0; i < count; i++) {
+            recreateSwapChain(*targets[0]);
+        }
+        printResizeStats();
+        resizeStats = ResizeStats();
+    }
+
+    void printResizeStats() {
+        if (resizeStats.count == 0) {
+            return;
+        }
+
+        std::cout << "swapchain recreation (" << (useDynamicRendering ? "dynamic rendering" : "render pass") << "): "
+                  << resizeStats.count << " times, "
+                  << resizeStats.totalMs / resizeStats.count << " ms avg, "
+                  << resizeStats.maxMs << " ms max\n";
+    }
+
+    // Median and tail of drawFrame() times, read back by the golden image tests to gate
+    // performance against tests/frame_times.baseline.
+    void writeFrameStats() {
+        if (options.statsFile.empty()) {
+            return;
+        }
+
+        std::ofstream file(options.statsFile);
+        if (!file.is_open()) {
+            throw std::runtime_error("failed to open " + options.statsFile + " for writing!");
+        }
+
+        size_t warmup = std::min(FRAME_STATS_WARMUP, frameTimesMs.size() / 2);
+        std::vector<double> times(frameTimesMs.begin() + static_cast<long>(warmup), frameTimesMs.end());
+        std::sort(times.begin(), times.end());
 
-        createSwapChain();
-        createImageViews();
-        createFramebuffers();
+        file << "frames " << times.size() << "\n";
+        if (!times.empty()) {
+            file << "median_ms " << times[times.size() / 2] << "\n"
+                 << "p95_ms " << times[std::min(times.size() - 1, times.size() * 95 / 100)] << "\n"
+                 << "max_ms " << times.back() << "\n";
+        }
+        if (useTextureStreaming) {
+            textureStreamer.writeStats(file);
+        }
     }
 
     void createInstance() {
@@ -255,7 +1004,8 @@ private:
         appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
         appInfo.pEngineName = "No Engine";
         appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-        appInfo.apiVersion = VK_API_VERSION_1_0;
+        instanceApiVersion = queryInstanceVersion();
+        appInfo.apiVersion = instanceApiVersion;
 
         VkInstanceCreateInfo createInfo{};
         createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -270,7 +1020,7 @@ private:
             createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
             createInfo.ppEnabledLayerNames = validationLayers.data();
 
-            populateDebugMessengerCreateInfo(debugCreateInfo);
+            debugMessageLog.populateCreateInfo(debugCreateInfo);
             createInfo.pNext = (VkDebugUtilsMessengerCreateInfoEXT*) &debugCreateInfo;
         } else {
             createInfo.enabledLayerCount = 0;
@@ -278,33 +1028,62 @@ private:
             createInfo.pNext = nullptr;
         }
 
-        if (vkCreateInstance(&createInfo, nullptr, &instance) != VK_SUCCESS) {
+        VkValidationFeaturesEXT validationFeatures{};
+        if (options.validationMode == ValidationMode::Synchronization) {
+            validationFeatures.sType = VK_STRUCTURE_TYPE_VALIDATION_FEATURES_EXT;
+            validationFeatures.pNext = createInfo.pNext;
+            validationFeatures.enabledValidationFeatureCount = static_cast<uint32_t>(syncValidationEnables.size());
+            validationFeatures.pEnabledValidationFeatures = syncValidationEnables.data();
+            validationFeatures.disabledValidationFeatureCount = static_cast<uint32_t>(syncValidationDisables.size());
+            validationFeatures.pDisabledValidationFeatures = syncValidationDisables.data();
+            createInfo.pNext = &validationFeatures;
+        }
+
+        if (vkCreateInstance(&createInfo, allocator, &instance) != VK_SUCCESS) {
             throw std::runtime_error("failed to create instance!");
         }
     }
 
-    void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo) {
-        createInfo = {};
-        createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
-        createInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
-        createInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
-        createInfo.pfnUserCallback = debugCallback;
+    // Highest version up to 1.3 the loader supports; a 1.0 loader has no vkEnumerateInstanceVersion.
+    uint32_t queryInstanceVersion() {
+        auto enumerateInstanceVersion = (PFN_vkEnumerateInstanceVersion) vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion");
+
+        uint32_t version = VK_API_VERSION_1_0;
+        if (enumerateInstanceVersion != nullptr && enumerateInstanceVersion(&version) != VK_SUCCESS) {
+            version = VK_API_VERSION_1_0;
+        }
+
+        return version >= VK_API_VERSION_1_3 ? VK_API_VERSION_1_3 : version;
     }
 
     void setupDebugMessenger() {
         if (!enableValidationLayers) return;
 
         VkDebugUtilsMessengerCreateInfoEXT createInfo;
-        populateDebugMessengerCreateInfo(createInfo);
+        debugMessageLog.populateCreateInfo(createInfo);
 
-        if (CreateDebugUtilsMessengerEXT(instance, &createInfo, nullptr, &debugMessenger) != VK_SUCCESS) {
+        if (CreateDebugUtilsMessengerEXT(instance, &createInfo, allocator, &debugMessenger) != VK_SUCCESS) {
             throw std::runtime_error("failed to set up debug messenger!");
         }
     }
 
-    void createSurface() {
-        if (glfwCreateWindowSurface(instance, window, nullptr, &surface) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create window surface!");
+    void createSurfaces() {
+        auto createHeadlessSurface = (PFN_vkCreateHeadlessSurfaceEXT) vkGetInstanceProcAddr(instance, "vkCreateHeadlessSurfaceEXT");
+
+        for (auto& target : targets) {
+            if (options.headless) {
+                VkHeadlessSurfaceCreateInfoEXT createInfo{};
+                createInfo.sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT;
+
+                if (createHeadlessSurface == nullptr || createHeadlessSurface(instance, &createInfo, allocator, &target->surface) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create headless surface!");
+                }
+                continue;
+            }
+
+            if (glfwCreateWindowSurface(instance, target->window, allocator, &target->surface) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create window surface!");
+            }
         }
     }
 
@@ -329,25 +1108,196 @@ private:
         if (physicalDevice == VK_NULL_HANDLE) {
             throw std::runtime_error("failed to find a suitable GPU!");
         }
+
+        useDynamicRendering = !options.forceRenderPass && checkDynamicRenderingSupport(physicalDevice);
+        usePresentWait = checkPresentWaitSupport(physicalDevice);
+        useTextureStreaming = !options.textureDirectory.empty();
+        useMemoryBudget = useTextureStreaming && checkMemoryBudgetSupport(physicalDevice);
+        msaaSamples = chooseSampleCount(options.msaaSamples);
+        depthFormat = findDepthFormat();
+        setupResolutionScaling();
+    }
+
+    void setupResolutionScaling() {
+        useScaledRendering = options.renderScale < 1.0 || options.gpuBudgetMs > 0.0;
+        if (!useScaledRendering) {
+            return;
+        }
+
+        // Timestamps are taken on the graphics queue.
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+        uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+        uint32_t validBits = queueFamilies[findQueueFamilies(physicalDevice).graphicsFamily.value()].timestampValidBits;
+
+        useGpuTimestamps = validBits != 0 && properties.limits.timestampPeriod > 0.0f;
+        timestampPeriodNs = properties.limits.timestampPeriod;
+        timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+        double gpuBudgetMs = options.gpuBudgetMs;
+        if (gpuBudgetMs > 0.0 && !useGpuTimestamps) {
+            std::cerr << "GPU timestamps are not supported, dynamic resolution disabled\n";
+            gpuBudgetMs = 0.0;
+        }
+        resolutionScaler.configure(gpuBudgetMs, gpuBudgetMs > 0.0 ? std::min(MIN_RENDER_SCALE, options.renderScale) : options.renderScale, options.renderScale);
+    }
+
+    // Highest sample count not above the requested one that both color and depth attachments support.
+    VkSampleCountFlagBits chooseSampleCount(uint32_t requested) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+        VkSampleCountFlags counts = properties.limits.framebufferColorSampleCounts & properties.limits.framebufferDepthSampleCounts;
+        const VkSampleCountFlagBits candidates[] = {
+            VK_SAMPLE_COUNT_64_BIT, VK_SAMPLE_COUNT_32_BIT, VK_SAMPLE_COUNT_16_BIT,
+            VK_SAMPLE_COUNT_8_BIT, VK_SAMPLE_COUNT_4_BIT, VK_SAMPLE_COUNT_2_BIT
+        };
+
+        for (VkSampleCountFlagBits candidate : candidates) {
+            if (static_cast<uint32_t>(candidate) <= requested && (counts & static_cast<VkSampleCountFlags>(candidate))) {
+                if (static_cast<uint32_t>(candidate) != requested) {
+                    std::cerr << "MSAA x" << requested << " is not supported, using x" << static_cast<uint32_t>(candidate) << "\n";
+                }
+                return candidate;
+            }
+        }
+
+        if (requested > 1) {
+            std::cerr << "MSAA x" << requested << " is not supported, multisampling disabled\n";
+        }
+        return VK_SAMPLE_COUNT_1_BIT;
+    }
+
+    VkFormat findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features) {
+        for (VkFormat format : candidates) {
+            VkFormatProperties props;
+            vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &props);
+
+            if (tiling == VK_IMAGE_TILING_LINEAR && (props.linearTilingFeatures & features) == features) {
+                return format;
+            } else if (tiling == VK_IMAGE_TILING_OPTIMAL && (props.optimalTilingFeatures & features) == features) {
+                return format;
+            }
+        }
+
+        throw std::runtime_error("failed to find supported format!");
+    }
+
+    VkFormat findDepthFormat() {
+        return findSupportedFormat(
+            {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
+            VK_IMAGE_TILING_OPTIMAL,
+            VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT
+        );
+    }
+
+    bool hasStencilComponent(VkFormat format) {
+        return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
+    }
+
+    // Dynamic rendering is used on 1.3 devices, or on 1.2 devices through VK_KHR_dynamic_rendering
+    // (its dependencies are core there). Anything older keeps the render pass path.
+    bool checkDynamicRenderingSupport(VkPhysicalDevice device) {
+        if (instanceApiVersion < VK_API_VERSION_1_2) {
+            return false;
+        }
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(device, &properties);
+        if (properties.apiVersion < VK_API_VERSION_1_2) {
+            return false;
+        }
+
+        dynamicRenderingIsCore = properties.apiVersion >= VK_API_VERSION_1_3 && instanceApiVersion >= VK_API_VERSION_1_3;
+        if (!dynamicRenderingIsCore && !isDeviceExtensionAvailable(device, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME)) {
+            return false;
+        }
+
+        VkPhysicalDeviceDynamicRenderingFeatures dynamicRenderingFeatures{};
+        dynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES;
+
+        VkPhysicalDeviceFeatures2 features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &dynamicRenderingFeatures;
+        vkGetPhysicalDeviceFeatures2(device, &features);
+
+        return dynamicRenderingFeatures.dynamicRendering == VK_TRUE;
+    }
+
+    bool checkPresentWaitSupport(VkPhysicalDevice device) {
+        if (instanceApiVersion < VK_API_VERSION_1_1
+            || !isDeviceExtensionAvailable(device, VK_KHR_PRESENT_ID_EXTENSION_NAME)
+            || !isDeviceExtensionAvailable(device, VK_KHR_PRESENT_WAIT_EXTENSION_NAME)) {
+            return false;
+        }
+
+        VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+        presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+
+        VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+        presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+        presentWaitFeatures.pNext = &presentIdFeatures;
+
+        VkPhysicalDeviceFeatures2 features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &presentWaitFeatures;
+        vkGetPhysicalDeviceFeatures2(device, &features);
+
+        return presentIdFeatures.presentId == VK_TRUE && presentWaitFeatures.presentWait == VK_TRUE;
+    }
+
+    // vkGetPhysicalDeviceMemoryProperties2 is core in 1.1.
+    bool checkMemoryBudgetSupport(VkPhysicalDevice device) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(device, &properties);
+        return instanceApiVersion >= VK_API_VERSION_1_1 && properties.apiVersion >= VK_API_VERSION_1_1
+            && isDeviceExtensionAvailable(device, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
     }
 
     void createLogicalDevice() {
         QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
 
         std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-        std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value()};
+        std::set<uint32_t> uniqueQueueFamilies = {
+            indices.graphicsFamily.value(),
+            indices.presentFamily.value(),
+            indices.computeFamily.value(),
+            indices.transferFamily.value()
+        };
 
-        float queuePriority = 1.0f;
+        // One queue per family; pQueuePriorities must outlive vkCreateDevice.
+        std::vector<float> queuePriorities(uniqueQueueFamilies.size(), 0.0f);
+        size_t familySlot = 0;
         for (uint32_t queueFamily : uniqueQueueFamilies) {
+            float& priority = queuePriorities[familySlot++];
+            if (queueFamily == indices.graphicsFamily || queueFamily == indices.presentFamily) {
+                priority = std::max(priority, GRAPHICS_QUEUE_PRIORITY);
+            }
+            if (queueFamily == indices.computeFamily) {
+                priority = std::max(priority, COMPUTE_QUEUE_PRIORITY);
+            }
+            if (queueFamily == indices.transferFamily) {
+                priority = std::max(priority, TRANSFER_QUEUE_PRIORITY);
+            }
+
             VkDeviceQueueCreateInfo queueCreateInfo{};
             queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
             queueCreateInfo.queueFamilyIndex = queueFamily;
             queueCreateInfo.queueCount = 1;
-            queueCreateInfo.pQueuePriorities = &queuePriority;
+            queueCreateInfo.pQueuePriorities = &priority;
             queueCreateInfos.push_back(queueCreateInfo);
         }
 
         VkPhysicalDeviceFeatures deviceFeatures{};
+        if (useTextureStreaming) {
+            VkPhysicalDeviceFeatures supportedFeatures;
+            vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+            deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
+        }
 
         VkDeviceCreateInfo createInfo{};
         createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -357,8 +1307,44 @@ private:
 
         createInfo.pEnabledFeatures = &deviceFeatures;
 
-        createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-        createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+        std::vector<const char*> enabledExtensions(deviceExtensions.begin(), deviceExtensions.end());
+
+        // Optional features are chained in front of each other into createInfo.pNext.
+        void* featureChain = nullptr;
+
+        VkPhysicalDeviceDynamicRenderingFeatures dynamicRenderingFeatures{};
+        dynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES;
+        dynamicRenderingFeatures.dynamicRendering = VK_TRUE;
+        if (useDynamicRendering) {
+            dynamicRenderingFeatures.pNext = featureChain;
+            featureChain = &dynamicRenderingFeatures;
+            if (!dynamicRenderingIsCore) {
+                enabledExtensions.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+            }
+        }
+
+        VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+        presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+        presentIdFeatures.presentId = VK_TRUE;
+        VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+        presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+        presentWaitFeatures.presentWait = VK_TRUE;
+        if (usePresentWait) {
+            presentIdFeatures.pNext = featureChain;
+            presentWaitFeatures.pNext = &presentIdFeatures;
+            featureChain = &presentWaitFeatures;
+            enabledExtensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+            enabledExtensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+        }
+
+        if (useMemoryBudget) {
+            enabledExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        }
+
+        createInfo.pNext = featureChain;
+
+        createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+        createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
         if (enableValidationLayers) {
             createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
@@ -367,20 +1353,35 @@ private:
             createInfo.enabledLayerCount = 0;
         }
 
-        if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &device) != VK_SUCCESS) {
+        if (vkCreateDevice(physicalDevice, &createInfo, allocator, &device) != VK_SUCCESS) {
             throw std::runtime_error("failed to create logical device!");
         }
 
         vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
         vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+        vkGetDeviceQueue(device, indices.computeFamily.value(), 0, &computeQueue);
+        vkGetDeviceQueue(device, indices.transferFamily.value(), 0, &transferQueue);
+
+        if (useDynamicRendering) {
+            cmdBeginRendering = (PFN_vkCmdBeginRenderingKHR) vkGetDeviceProcAddr(device, dynamicRenderingIsCore ? "vkCmdBeginRendering" : "vkCmdBeginRenderingKHR");
+            cmdEndRendering = (PFN_vkCmdEndRenderingKHR) vkGetDeviceProcAddr(device, dynamicRenderingIsCore ? "vkCmdEndRendering" : "vkCmdEndRenderingKHR");
+            if (cmdBeginRendering == nullptr || cmdEndRendering == nullptr) {
+                throw std::runtime_error("failed to load dynamic rendering commands!");
+            }
+        }
+
+        if (usePresentWait) {
+            waitForPresent = (PFN_vkWaitForPresentKHR) vkGetDeviceProcAddr(device, "vkWaitForPresentKHR");
+            usePresentWait = waitForPresent != nullptr;
+        }
     }
 
-    void createSwapChain() {
-        SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice);
+    void createSwapChain(PresentTarget& target) {
+        querySwapChainSupport(physicalDevice, target.surface, target.swapChainSupport);
+        const SwapChainSupportDetails& swapChainSupport = target.swapChainSupport;
 
-        VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
         VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
-        VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
+        VkExtent2D extent = chooseSwapExtent(target, swapChainSupport.capabilities);
 
         uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
         if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount) {
@@ -389,14 +1390,27 @@ private:
 
         VkSwapchainCreateInfoKHR createInfo{};
         createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-        createInfo.surface = surface;
+        createInfo.surface = target.surface;
 
         createInfo.minImageCount = imageCount;
-        createInfo.imageFormat = surfaceFormat.format;
-        createInfo.imageColorSpace = surfaceFormat.colorSpace;
+        createInfo.imageFormat = swapChainImageFormat;
+        createInfo.imageColorSpace = swapChainColorSpace;
         createInfo.imageExtent = extent;
         createInfo.imageArrayLayers = 1;
         createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        if (useScaledRendering || options.computeOverlay) {
+            if (!(swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT)) {
+                throw std::runtime_error(useScaledRendering ? "swap chain images cannot be blitted to, scaled rendering is not supported!"
+                                                            : "swap chain images cannot be blitted to, the compute overlay is not supported!");
+            }
+            createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        }
+        if (frameCapture.isActive() && target.index == 0) {
+            if (!(swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT)) {
+                throw std::runtime_error("swap chain images cannot be copied, frame capture is not supported!");
+            }
+            createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        }
 
         QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
         uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(), indices.presentFamily.value()};
@@ -414,25 +1428,25 @@ private:
         createInfo.presentMode = presentMode;
         createInfo.clipped = VK_TRUE;
 
-        if (vkCreateSwapchainKHR(device, &createInfo, nullptr, &swapChain) != VK_SUCCESS) {
+        if (vkCreateSwapchainKHR(device, &createInfo, allocator, &target.swapChain) != VK_SUCCESS) {
             throw std::runtime_error("failed to create swap chain!");
         }
 
-        vkGetSwapchainImagesKHR(device, swapChain, &imageCount, nullptr);
-        swapChainImages.resize(imageCount);
-        vkGetSwapchainImagesKHR(device, swapChain, &imageCount, swapChainImages.data());
+        vkGetSwapchainImagesKHR(device, target.swapChain, &imageCount, nullptr);
+        target.swapChainImages.resize(imageCount);
+        vkGetSwapchainImagesKHR(device, target.swapChain, &imageCount, target.swapChainImages.data());
 
-        swapChainImageFormat = surfaceFormat.format;
-        swapChainExtent = extent;
+        target.swapChainExtent = extent;
+        target.firstPresentId = presentId + 1;
     }
 
-    void createImageViews() {
-        swapChainImageViews.resize(swapChainImages.size());
+    void createImageViews(PresentTarget& target) {
+        target.swapChainImageViews.resize(target.swapChainImages.size());
 
-        for (size_t i = 0; i < swapChainImages.size(); i++) {
+        for (size_t i = 0; i < target.swapChainImages.size(); i++) {
             VkImageViewCreateInfo createInfo{};
             createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-            createInfo.image = swapChainImages[i];
+            createInfo.image = target.swapChainImages[i];
             createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
             createInfo.format = swapChainImageFormat;
             createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
@@ -445,50 +1459,81 @@ private:
             createInfo.subresourceRange.baseArrayLayer = 0;
             createInfo.subresourceRange.layerCount = 1;
 
-            if (vkCreateImageView(device, &createInfo, nullptr, &swapChainImageViews[i]) != VK_SUCCESS) {
+            if (vkCreateImageView(device, &createInfo, allocator, &target.swapChainImageViews[i]) != VK_SUCCESS) {
                 throw std::runtime_error("failed to create image views!");
             }
         }
     }
 
     void createRenderPass() {
+        if (useDynamicRendering) {
+            return;
+        }
+
+        // Layout transitions and synchronization with the acquire and present are done by
+        // frameGraph's barriers, so the render pass neither transitions nor declares dependencies.
+        // The multisampled color and the depth buffer are never stored: on tilers they stay in
+        // tile memory and their lazily allocated backing is never committed.
+        bool multisampled = msaaSamples != VK_SAMPLE_COUNT_1_BIT;
+
         VkAttachmentDescription colorAttachment{};
         colorAttachment.format = swapChainImageFormat;
-        colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        colorAttachment.samples = msaaSamples;
         colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        colorAttachment.storeOp = multisampled ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
         colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
         colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+        VkAttachmentDescription depthAttachment{};
+        depthAttachment.format = depthFormat;
+        depthAttachment.samples = msaaSamples;
+        depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        depthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+        VkAttachmentDescription colorAttachmentResolve{};
+        colorAttachmentResolve.format = swapChainImageFormat;
+        colorAttachmentResolve.samples = VK_SAMPLE_COUNT_1_BIT;
+        colorAttachmentResolve.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        colorAttachmentResolve.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        colorAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
         VkAttachmentReference colorAttachmentRef{};
         colorAttachmentRef.attachment = 0;
         colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+        VkAttachmentReference depthAttachmentRef{};
+        depthAttachmentRef.attachment = 1;
+        depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+        VkAttachmentReference colorAttachmentResolveRef{};
+        colorAttachmentResolveRef.attachment = 2;
+        colorAttachmentResolveRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
         VkSubpassDescription subpass{};
         subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
         subpass.colorAttachmentCount = 1;
         subpass.pColorAttachments = &colorAttachmentRef;
+        subpass.pDepthStencilAttachment = &depthAttachmentRef;
+        subpass.pResolveAttachments = multisampled ? &colorAttachmentResolveRef : nullptr;
 
-        VkSubpassDependency dependency{};
-        dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-        dependency.dstSubpass = 0;
-        dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        dependency.srcAccessMask = 0;
-        dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
+        VkAttachmentDescription attachments[] = {colorAttachment, depthAttachment, colorAttachmentResolve};
         VkRenderPassCreateInfo renderPassInfo{};
         renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-        renderPassInfo.attachmentCount = 1;
-        renderPassInfo.pAttachments = &colorAttachment;
+        renderPassInfo.attachmentCount = multisampled ? 3 : 2;
+        renderPassInfo.pAttachments = attachments;
         renderPassInfo.subpassCount = 1;
         renderPassInfo.pSubpasses = &subpass;
-        renderPassInfo.dependencyCount = 1;
-        renderPassInfo.pDependencies = &dependency;
 
-        if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
+        if (vkCreateRenderPass(device, &renderPassInfo, allocator, &renderPass) != VK_SUCCESS) {
             throw std::runtime_error("failed to create render pass!");
         }
     }
@@ -542,7 +1587,15 @@ private:
         VkPipelineMultisampleStateCreateInfo multisampling{};
         multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
         multisampling.sampleShadingEnable = VK_FALSE;
-        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+        multisampling.rasterizationSamples = msaaSamples;
+
+        VkPipelineDepthStencilStateCreateInfo depthStencil{};
+        depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        depthStencil.depthTestEnable = VK_TRUE;
+        depthStencil.depthWriteEnable = VK_TRUE;
+        depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+        depthStencil.depthBoundsTestEnable = VK_FALSE;
+        depthStencil.stencilTestEnable = VK_FALSE;
 
         VkPipelineColorBlendAttachmentState colorBlendAttachment{};
         colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
@@ -559,7 +1612,7 @@ private:
         colorBlending.blendConstants[2] = 0.0f;
         colorBlending.blendConstants[3] = 0.0f;
 
-        std::vector<VkDynamicState> dynamicStates = {
+        const std::array<VkDynamicState, 2> dynamicStates = {
             VK_DYNAMIC_STATE_VIEWPORT,
             VK_DYNAMIC_STATE_SCISSOR
         };
@@ -573,7 +1626,7 @@ private:
         pipelineLayoutInfo.setLayoutCount = 0;
         pipelineLayoutInfo.pushConstantRangeCount = 0;
 
-        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, allocator, &pipelineLayout) != VK_SUCCESS) {
             throw std::runtime_error("failed to create pipeline layout!");
         }
 
@@ -586,6 +1639,7 @@ private:
         pipelineInfo.pViewportState = &viewportState;
         pipelineInfo.pRasterizationState = &rasterizer;
         pipelineInfo.pMultisampleState = &multisampling;
+        pipelineInfo.pDepthStencilState = &depthStencil;
         pipelineInfo.pColorBlendState = &colorBlending;
         pipelineInfo.pDynamicState = &dynamicState;
         pipelineInfo.layout = pipelineLayout;
@@ -593,37 +1647,423 @@ private:
         pipelineInfo.subpass = 0;
         pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-        if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
+        // With dynamic rendering the pipeline only needs the attachment formats, not a render pass.
+        VkPipelineRenderingCreateInfo renderingInfo{};
+        renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+        renderingInfo.colorAttachmentCount = 1;
+        renderingInfo.pColorAttachmentFormats = &swapChainImageFormat;
+        renderingInfo.depthAttachmentFormat = depthFormat;
+        if (useDynamicRendering) {
+            pipelineInfo.pNext = &renderingInfo;
+            pipelineInfo.renderPass = VK_NULL_HANDLE;
+        }
+
+        if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, allocator, &graphicsPipeline) != VK_SUCCESS) {
             throw std::runtime_error("failed to create graphics pipeline!");
         }
 
-        vkDestroyShaderModule(device, fragShaderModule, nullptr);
-        vkDestroyShaderModule(device, vertShaderModule, nullptr);
+        vkDestroyShaderModule(device, fragShaderModule, allocator);
+        vkDestroyShaderModule(device, vertShaderModule, allocator);
+    }
+
+    // --compute-overlay: the overlay pass writes a storage image on the async compute queue
+    // and the overlay composite pass blits it into the backbuffer (see createFrameGraph()).
+    // The images are not sized after the swapchain, so they live as long as the device.
+    void createComputeOverlay() {
+        VkFormatProperties props;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, swapChainImageFormat, &props);
+        if (!(props.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT)) {
+            throw std::runtime_error("swap chain format cannot be blitted to, the compute overlay is not supported!");
+        }
+
+        VkDescriptorSetLayoutBinding binding{};
+        binding.binding = 0;
+        binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        binding.descriptorCount = 1;
+        binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = 1;
+        layoutInfo.pBindings = &binding;
+
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, allocator, &overlayDescriptorSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create overlay descriptor set layout!");
+        }
+
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(uint32_t); // frame
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &overlayDescriptorSetLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, allocator, &overlayPipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create overlay pipeline layout!");
+        }
+
+        auto shaderCode = readFile("shaders/overlay.comp.spv");
+        VkShaderModule shaderModule = createShaderModule(shaderCode);
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = shaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = overlayPipelineLayout;
+
+        if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, allocator, &overlayPipeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create overlay pipeline!");
+        }
+
+        vkDestroyShaderModule(device, shaderModule, allocator);
+
+        uint32_t setCount = static_cast<uint32_t>(targets.size() * MAX_FRAMES_IN_FLIGHT);
+
+        VkDescriptorPoolSize poolSize{};
+        poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        poolSize.descriptorCount = setCount;
+
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.maxSets = setCount;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+
+        if (vkCreateDescriptorPool(device, &poolInfo, allocator, &overlayDescriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create overlay descriptor pool!");
+        }
+
+        std::vector<VkDescriptorSetLayout> setLayouts(setCount, overlayDescriptorSetLayout);
+        std::vector<VkDescriptorSet> descriptorSets(setCount);
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = overlayDescriptorPool;
+        allocInfo.descriptorSetCount = setCount;
+        allocInfo.pSetLayouts = setLayouts.data();
+
+        if (vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate overlay descriptor sets!");
+        }
+
+        size_t nextSet = 0;
+        for (auto& target : targets) {
+            for (auto& overlay : target->overlayImages) {
+                createOverlayImage(overlay);
+                overlay.descriptorSet = descriptorSets[nextSet++];
+
+                VkDescriptorImageInfo imageInfo{};
+                imageInfo.imageView = overlay.view;
+                imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL; // RenderGraphUsage::ComputeStorage
+
+                VkWriteDescriptorSet descriptorWrite{};
+                descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                descriptorWrite.dstSet = overlay.descriptorSet;
+                descriptorWrite.dstBinding = 0;
+                descriptorWrite.dstArrayElement = 0;
+                descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+                descriptorWrite.descriptorCount = 1;
+                descriptorWrite.pImageInfo = &imageInfo;
+
+                vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+            }
+        }
     }
 
-    void createFramebuffers() {
-        swapChainFramebuffers.resize(swapChainImageViews.size());
+    // Exclusive to one queue family at a time: the render graph transfers its ownership
+    // from the async compute queue to the graphics one every frame.
+    void createOverlayImage(OverlayImage& overlay) {
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = OVERLAY_FORMAT;
+        imageInfo.extent = {OVERLAY_SIZE, OVERLAY_SIZE, 1};
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        if (vkCreateImage(device, &imageInfo, allocator, &overlay.image) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create overlay image!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(device, overlay.image, &memRequirements);
+
+        std::optional<uint32_t> memoryType = findMemoryType(physicalDevice, memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        if (!memoryType.has_value()) {
+            throw std::runtime_error("failed to find a memory type for the overlay image!");
+        }
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = memRequirements.size;
+        allocInfo.memoryTypeIndex = memoryType.value();
+
+        if (vkAllocateMemory(device, &allocInfo, allocator, &overlay.memory) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate overlay image memory!");
+        }
+        vkBindImageMemory(device, overlay.image, overlay.memory, 0);
+
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = overlay.image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = OVERLAY_FORMAT;
+        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewInfo.subresourceRange.baseMipLevel = 0;
+        viewInfo.subresourceRange.levelCount = 1;
+        viewInfo.subresourceRange.baseArrayLayer = 0;
+        viewInfo.subresourceRange.layerCount = 1;
+
+        if (vkCreateImageView(device, &viewInfo, allocator, &overlay.view) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create overlay image view!");
+        }
+    }
 
-        for (size_t i = 0; i < swapChainImageViews.size(); i++) {
+    void destroyComputeOverlay() {
+        for (auto& target : targets) {
+            for (auto& overlay : target->overlayImages) {
+                vkDestroyImageView(device, overlay.view, allocator);
+                vkDestroyImage(device, overlay.image, allocator);
+                vkFreeMemory(device, overlay.memory, allocator);
+                overlay = OverlayImage();
+            }
+        }
+
+        vkDestroyDescriptorPool(device, overlayDescriptorPool, allocator); // frees the descriptor sets
+        vkDestroyPipeline(device, overlayPipeline, allocator);
+        vkDestroyPipelineLayout(device, overlayPipelineLayout, allocator);
+        vkDestroyDescriptorSetLayout(device, overlayDescriptorSetLayout, allocator);
+    }
+
+    void createFramebuffers(PresentTarget& target) {
+        if (useDynamicRendering) {
+            return;
+        }
+
+        target.swapChainFramebuffers.resize(target.swapChainImageViews.size());
+
+        const RenderGraph& frameGraph = target.frameGraph;
+        bool multisampled = msaaSamples != VK_SAMPLE_COUNT_1_BIT;
+        for (size_t i = 0; i < target.swapChainImageViews.size(); i++) {
+            // Same order as the attachments in createRenderPass(); the graph owns the color and depth targets.
+            VkImageView sceneView = target.sceneColor == target.backbuffer ? target.swapChainImageViews[i] : frameGraph.getImageView(target.sceneColor);
             VkImageView attachments[] = {
-                swapChainImageViews[i]
+                multisampled ? frameGraph.getImageView(target.colorTarget) : sceneView,
+                frameGraph.getImageView(target.depthBuffer),
+                sceneView
             };
 
             VkFramebufferCreateInfo framebufferInfo{};
             framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
             framebufferInfo.renderPass = renderPass;
-            framebufferInfo.attachmentCount = 1;
+            framebufferInfo.attachmentCount = multisampled ? 3 : 2;
             framebufferInfo.pAttachments = attachments;
-            framebufferInfo.width = swapChainExtent.width;
-            framebufferInfo.height = swapChainExtent.height;
+            framebufferInfo.width = target.swapChainExtent.width;
+            framebufferInfo.height = target.swapChainExtent.height;
             framebufferInfo.layers = 1;
 
-            if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &swapChainFramebuffers[i]) != VK_SUCCESS) {
+            if (vkCreateFramebuffer(device, &framebufferInfo, allocator, &target.swapChainFramebuffers[i]) != VK_SUCCESS) {
                 throw std::runtime_error("failed to create framebuffer!");
             }
         }
     }
 
+    // Declares the frame's passes and what they touch; the graph derives ordering, layout
+    // transitions and barriers. Rebuilt with the swapchain since owned images follow its extent.
+    void createFrameGraph(PresentTarget& target) {
+        RenderGraph& frameGraph = target.frameGraph;
+        VkExtent2D extent = target.swapChainExtent;
+
+        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+        frameGraph.setQueueFamilies(indices.graphicsFamily.value(), indices.computeFamily.value());
+
+        target.backbuffer = frameGraph.importImage(
+            "backbuffer",
+            VK_IMAGE_ASPECT_COLOR_BIT,
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, // imageAvailableSemaphores wait stage
+            VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+
+        // Multisampled color and depth only live inside the triangle pass, so they are transient
+        // attachments backed by lazily allocated memory where the device offers it.
+        VkImageAspectFlags depthAspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+        if (hasStencilComponent(depthFormat)) {
+            depthAspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+        }
+        target.depthBuffer = frameGraph.createImage("depth", RenderGraphImageDesc(
+            depthFormat,
+            extent,
+            msaaSamples,
+            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+            depthAspect,
+            true));
+
+        // With scaled rendering the triangle pass draws into sceneColor, which the upscale
+        // pass then blits to the backbuffer.
+        target.sceneColor = target.backbuffer;
+        if (useScaledRendering) {
+            target.sceneColor = frameGraph.createImage("scene color", RenderGraphImageDesc(
+                swapChainImageFormat,
+                extent,
+                VK_SAMPLE_COUNT_1_BIT,
+                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                VK_IMAGE_ASPECT_COLOR_BIT,
+                false));
+            target.upscaleFilter = chooseUpscaleFilter();
+        }
+
+        target.colorTarget = target.sceneColor;
+        if (msaaSamples != VK_SAMPLE_COUNT_1_BIT) {
+            target.colorTarget = frameGraph.createImage("msaa color", RenderGraphImageDesc(
+                swapChainImageFormat,
+                extent,
+                msaaSamples,
+                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+                VK_IMAGE_ASPECT_COLOR_BIT,
+                true));
+        }
+
+        PresentTarget* passTarget = &target;
+        RenderGraphPass trianglePass = frameGraph.addPass("triangle", [this, passTarget](VkCommandBuffer commandBuffer) {
+            recordTrianglePass(commandBuffer, *passTarget);
+        });
+        frameGraph.write(trianglePass, target.depthBuffer, RenderGraphUsage::DepthStencilAttachment);
+        frameGraph.write(trianglePass, target.colorTarget, RenderGraphUsage::ColorAttachment);
+        if (target.colorTarget != target.sceneColor) {
+            frameGraph.write(trianglePass, target.sceneColor, RenderGraphUsage::ColorAttachment); // resolve target
+        }
+
+        if (target.sceneColor != target.backbuffer) {
+            RenderGraphPass upscalePass = frameGraph.addPass("upscale", [this, passTarget](VkCommandBuffer commandBuffer) {
+                recordUpscalePass(commandBuffer, *passTarget);
+            });
+            frameGraph.read(upscalePass, target.sceneColor, RenderGraphUsage::TransferSrc);
+            frameGraph.write(upscalePass, target.backbuffer, RenderGraphUsage::TransferDst);
+        }
+
+        // The overlay is drawn from scratch every frame, so it comes in undefined and the
+        // graph can hand it from the async compute queue to the graphics one without waiting
+        // on anything but the compute submission.
+        if (options.computeOverlay) {
+            target.overlay = frameGraph.importImage("overlay", VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, 0, VK_IMAGE_LAYOUT_UNDEFINED);
+
+            RenderGraphPass overlayPass = frameGraph.addPass("overlay", [this, passTarget](VkCommandBuffer commandBuffer) {
+                recordOverlayPass(commandBuffer, *passTarget);
+            }, RenderGraphQueue::AsyncCompute);
+            frameGraph.write(overlayPass, target.overlay, RenderGraphUsage::ComputeStorage);
+
+            RenderGraphPass compositePass = frameGraph.addPass("overlay composite", [this, passTarget](VkCommandBuffer commandBuffer) {
+                recordOverlayComposite(commandBuffer, *passTarget);
+            });
+            frameGraph.read(compositePass, target.overlay, RenderGraphUsage::TransferSrc);
+            frameGraph.write(compositePass, target.backbuffer, RenderGraphUsage::TransferDst);
+        }
+
+        if (frameCapture.isActive() && target.index == 0) {
+            frameCapture.createBuffers(device, physicalDevice, extent, swapChainImageFormat, allocator);
+
+            RenderGraphPass capturePass = frameGraph.addPass("capture", [this, passTarget](VkCommandBuffer commandBuffer) {
+                frameCapture.recordCopy(commandBuffer, passTarget->frameGraph.getImage(passTarget->backbuffer), currentFrame);
+            });
+            frameGraph.read(capturePass, target.backbuffer, RenderGraphUsage::TransferSrc);
+            frameGraph.setSideEffects(capturePass);
+        }
+
+        frameGraph.compile(device, physicalDevice, allocator);
+    }
+
+    VkFilter chooseUpscaleFilter() {
+        VkFormatProperties props;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, swapChainImageFormat, &props);
+
+        VkFormatFeatureFlags blit = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT;
+        if ((props.optimalTilingFeatures & blit) != blit) {
+            throw std::runtime_error("swap chain format cannot be blitted, scaled rendering is not supported!");
+        }
+
+        return (props.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+    }
+
+    void createTimestampQueries() {
+        if (!useGpuTimestamps) {
+            return;
+        }
+
+        VkQueryPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        poolInfo.queryCount = 2 * MAX_FRAMES_IN_FLIGHT;
+
+        if (vkCreateQueryPool(device, &poolInfo, allocator, &timestampPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create timestamp query pool!");
+        }
+    }
+
+    void createMesh() {
+        auto start = std::chrono::steady_clock::now();
+        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+        MeshUploadQueues queues(transferQueue, indices.transferFamily.value(), transferCommandPool,
+            graphicsQueue, indices.graphicsFamily.value(), commandPool);
+        mesh = loadMesh(options.meshFile, device, physicalDevice, allocator, queues);
+        double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << "mesh " << options.meshFile << ": " << mesh.vertexCount << " vertices, " << mesh.indexCount / 3 << " triangles, "
+                  << mesh.meshletCount << " meshlets, " << static_cast<double>(mesh.size) / (1024.0 * 1024.0)
+                  << " MiB loaded in " << elapsedMs << " ms" << (mesh.staged ? " (staged)" : " (direct)") << std::endl;
+    }
+
+    // Textures are opened in name order so their indices are stable between runs.
+    void createTextures() {
+        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+        textureStreamer.create(device, physicalDevice, allocator, MAX_FRAMES_IN_FLIGHT, indices.graphicsFamily.value(),
+            indices.transferFamily.value(), transferQueue, useMemoryBudget, options.textureBudgetMiB * 1024 * 1024);
+
+        std::vector<std::filesystem::path> files;
+        for (const auto& entry : std::filesystem::directory_iterator(options.textureDirectory)) {
+            if (entry.is_regular_file() && entry.path().extension() == ".ktx2") {
+                files.push_back(entry.path());
+            }
+        }
+        if (files.empty()) {
+            throw std::runtime_error("no .ktx2 textures in " + options.textureDirectory + "!");
+        }
+        std::sort(files.begin(), files.end());
+
+        for (const auto& file : files) {
+            textureStreamer.addTexture(file.string());
+        }
+        textureStreamer.start();
+    }
+
+    // Feeds the GPU time of the frame that last used currentFrame's resources (its fence has
+    // just been waited on) to the resolution controller.
+    void updateRenderScale() {
+        if (!useGpuTimestamps || !timestampsPending[currentFrame]) {
+            return;
+        }
+        timestampsPending[currentFrame] = false;
+
+        uint64_t timestamps[2];
+        if (vkGetQueryPoolResults(device, timestampPool, 2 * currentFrame, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+            return;
+        }
+
+        uint64_t ticks = (timestamps[1] - timestamps[0]) & timestampMask;
+        resolutionScaler.update(framesRendered, static_cast<double>(ticks) * timestampPeriodNs / 1e6);
+    }
+
     void createCommandPool() {
         QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
 
@@ -632,9 +2072,27 @@ private:
         poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
         poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
 
-        if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+        if (vkCreateCommandPool(device, &poolInfo, allocator, &commandPool) != VK_SUCCESS) {
             throw std::runtime_error("failed to create command pool!");
         }
+
+        VkCommandPoolCreateInfo computePoolInfo{};
+        computePoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        computePoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        computePoolInfo.queueFamilyIndex = queueFamilyIndices.computeFamily.value();
+
+        if (vkCreateCommandPool(device, &computePoolInfo, allocator, &computeCommandPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create compute command pool!");
+        }
+
+        VkCommandPoolCreateInfo transferPoolInfo{};
+        transferPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        transferPoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        transferPoolInfo.queueFamilyIndex = queueFamilyIndices.transferFamily.value();
+
+        if (vkCreateCommandPool(device, &transferPoolInfo, allocator, &transferCommandPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create transfer command pool!");
+        }
     }
 
     void createCommandBuffers() {
@@ -649,9 +2107,84 @@ private:
         if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
             throw std::runtime_error("failed to allocate command buffers!");
         }
+
+        computeCommandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+
+        VkCommandBufferAllocateInfo computeAllocInfo{};
+        computeAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        computeAllocInfo.commandPool = computeCommandPool;
+        computeAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        computeAllocInfo.commandBufferCount = (uint32_t) computeCommandBuffers.size();
+
+        if (vkAllocateCommandBuffers(device, &computeAllocInfo, computeCommandBuffers.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate compute command buffers!");
+        }
+    }
+
+    // Records the async compute passes of every target's graph into one command buffer for
+    // the compute queue and returns the graphics stages that have to wait for it, or 0 when
+    // there was nothing to submit (without a compute-only family the graphs record those
+    // passes with the graphics ones). No fence is needed: the graphics submission waits on
+    // computeFinishedSemaphores, so inFlightFences[currentFrame] also covers this submission.
+    VkPipelineStageFlags submitAsyncCompute(const std::array<PresentTarget*, MAX_WINDOWS>& frameTargets, uint32_t frameTargetCount) {
+        bool asyncCompute = false;
+        for (uint32_t i = 0; i < frameTargetCount; i++) {
+            asyncCompute = asyncCompute || frameTargets[i]->frameGraph.hasAsyncCompute();
+        }
+        if (!asyncCompute) {
+            return 0;
+        }
+
+        VkCommandBuffer commandBuffer = computeCommandBuffers[currentFrame];
+        vkResetCommandBuffer(commandBuffer, 0);
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin recording compute command buffer!");
+        }
+
+        VkPipelineStageFlags waitStage = 0;
+        for (uint32_t i = 0; i < frameTargetCount; i++) {
+            RenderGraph& frameGraph = frameTargets[i]->frameGraph;
+            if (frameGraph.hasAsyncCompute()) {
+                frameGraph.executeAsyncCompute(commandBuffer);
+                waitStage |= frameGraph.getAsyncComputeWaitStages();
+            }
+        }
+
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record compute command buffer!");
+        }
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &computeFinishedSemaphores[currentFrame];
+
+        if (vkQueueSubmit(computeQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit compute command buffer!");
+        }
+
+        // Only an async pass whose results no graphics pass uses leaves no wait stage behind.
+        return waitStage != 0 ? waitStage : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+    }
+
+    // Points the imported images of target's graph at this frame's swapchain image and overlay.
+    void bindFrameImages(PresentTarget& target) {
+        target.frameGraph.setImportedImage(target.backbuffer, target.swapChainImages[target.imageIndex], target.swapChainImageViews[target.imageIndex]);
+        if (options.computeOverlay) {
+            const OverlayImage& overlay = target.overlayImages[currentFrame];
+            target.frameGraph.setImportedImage(target.overlay, overlay.image, overlay.view);
+        }
     }
 
-    void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+    // Records every target that acquired an image this frame into one command buffer.
+    void recordCommandBuffer(VkCommandBuffer commandBuffer, const std::array<PresentTarget*, MAX_WINDOWS>& frameTargets, uint32_t frameTargetCount) {
         VkCommandBufferBeginInfo beginInfo{};
         beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 
@@ -659,47 +2192,161 @@ private:
             throw std::runtime_error("failed to begin recording command buffer!");
         }
 
+        if (useGpuTimestamps) {
+            vkCmdResetQueryPool(commandBuffer, timestampPool, 2 * currentFrame, 2);
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampPool, 2 * currentFrame);
+        }
+
+        if (useTextureStreaming) {
+            textureStreamer.recordUploads(commandBuffer, currentFrame);
+        }
+
+        for (uint32_t i = 0; i < frameTargetCount; i++) {
+            PresentTarget& target = *frameTargets[i];
+            target.renderExtent = useScaledRendering ? resolutionScaler.scaledExtent(target.swapChainExtent) : target.swapChainExtent;
+            target.frameGraph.execute(commandBuffer);
+        }
+
+        if (useGpuTimestamps) {
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampPool, 2 * currentFrame + 1);
+            timestampsPending[currentFrame] = true;
+        }
+
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record command buffer!");
+        }
+    }
+
+    void recordTrianglePass(VkCommandBuffer commandBuffer, const PresentTarget& target) {
+        const RenderGraph& frameGraph = target.frameGraph;
+        bool multisampled = msaaSamples != VK_SAMPLE_COUNT_1_BIT;
+
+        VkClearValue clearValues[3]{};
+        const FrameSnapshot& snapshot = snapshots.readBuffer();
+        clearValues[0].color = {{snapshot.clearColor[0], snapshot.clearColor[1], snapshot.clearColor[2], snapshot.clearColor[3]}};
+        clearValues[1].depthStencil = {1.0f, 0};
+
+        if (useDynamicRendering) {
+            VkRenderingAttachmentInfo colorAttachment{};
+            colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+            colorAttachment.imageView = frameGraph.getImageView(target.colorTarget);
+            colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+            colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+            colorAttachment.storeOp = multisampled ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
+            colorAttachment.clearValue = clearValues[0];
+            if (multisampled) {
+                colorAttachment.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
+                colorAttachment.resolveImageView = frameGraph.getImageView(target.sceneColor);
+                colorAttachment.resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+            }
+
+            VkRenderingAttachmentInfo depthAttachment{};
+            depthAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+            depthAttachment.imageView = frameGraph.getImageView(target.depthBuffer);
+            depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+            depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+            depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            depthAttachment.clearValue = clearValues[1];
+
+            VkRenderingInfo renderingInfo{};
+            renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+            renderingInfo.renderArea.offset = {0, 0};
+            renderingInfo.renderArea.extent = target.renderExtent;
+            renderingInfo.layerCount = 1;
+            renderingInfo.colorAttachmentCount = 1;
+            renderingInfo.pColorAttachments = &colorAttachment;
+            renderingInfo.pDepthAttachment = &depthAttachment;
+
+            cmdBeginRendering(commandBuffer, &renderingInfo);
+                drawTriangle(commandBuffer, target.renderExtent);
+            cmdEndRendering(commandBuffer);
+            return;
+        }
+
         VkRenderPassBeginInfo renderPassInfo{};
         renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
         renderPassInfo.renderPass = renderPass;
-        renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
+        renderPassInfo.framebuffer = target.swapChainFramebuffers[target.imageIndex];
         renderPassInfo.renderArea.offset = {0, 0};
-        renderPassInfo.renderArea.extent = swapChainExtent;
+        renderPassInfo.renderArea.extent = target.renderExtent;
 
-        VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
-        renderPassInfo.clearValueCount = 1;
-        renderPassInfo.pClearValues = &clearColor;
+        renderPassInfo.clearValueCount = multisampled ? 3 : 2;
+        renderPassInfo.pClearValues = clearValues;
 
         vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+            drawTriangle(commandBuffer, target.renderExtent);
+        vkCmdEndRenderPass(commandBuffer);
+    }
 
-            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+    void drawTriangle(VkCommandBuffer commandBuffer, VkExtent2D renderExtent) {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
 
-            VkViewport viewport{};
-            viewport.x = 0.0f;
-            viewport.y = 0.0f;
-            viewport.width = (float) swapChainExtent.width;
-            viewport.height = (float) swapChainExtent.height;
-            viewport.minDepth = 0.0f;
-            viewport.maxDepth = 1.0f;
-            vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+        VkViewport viewport{};
+        viewport.x = 0.0f;
+        viewport.y = 0.0f;
+        viewport.width = (float) renderExtent.width;
+        viewport.height = (float) renderExtent.height;
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
-            VkRect2D scissor{};
-            scissor.offset = {0, 0};
-            scissor.extent = swapChainExtent;
-            vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+        VkRect2D scissor{};
+        scissor.offset = {0, 0};
+        scissor.extent = renderExtent;
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-            vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+        vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+    }
 
-        vkCmdEndRenderPass(commandBuffer);
+    void recordUpscalePass(VkCommandBuffer commandBuffer, const PresentTarget& target) {
+        VkImageBlit blit{};
+        blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.srcSubresource.layerCount = 1;
+        blit.srcOffsets[1] = {static_cast<int32_t>(target.renderExtent.width), static_cast<int32_t>(target.renderExtent.height), 1};
+        blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.dstSubresource.layerCount = 1;
+        blit.dstOffsets[1] = {static_cast<int32_t>(target.swapChainExtent.width), static_cast<int32_t>(target.swapChainExtent.height), 1};
+
+        vkCmdBlitImage(commandBuffer,
+            target.frameGraph.getImage(target.sceneColor), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            target.frameGraph.getImage(target.backbuffer), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            1, &blit, target.upscaleFilter);
+    }
 
-        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
-            throw std::runtime_error("failed to record command buffer!");
+    void recordOverlayPass(VkCommandBuffer commandBuffer, const PresentTarget& target) {
+        uint32_t frame = static_cast<uint32_t>(framesRendered);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, overlayPipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, overlayPipelineLayout, 0, 1, &target.overlayImages[currentFrame].descriptorSet, 0, nullptr);
+        vkCmdPushConstants(commandBuffer, overlayPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(frame), &frame);
+        vkCmdDispatch(commandBuffer, OVERLAY_SIZE / OVERLAY_GROUP_SIZE, OVERLAY_SIZE / OVERLAY_GROUP_SIZE, 1);
+    }
+
+    void recordOverlayComposite(VkCommandBuffer commandBuffer, const PresentTarget& target) {
+        // Windows too small for all of it get what fits.
+        int32_t width = std::min(static_cast<int32_t>(OVERLAY_SIZE), static_cast<int32_t>(target.swapChainExtent.width) - OVERLAY_MARGIN);
+        int32_t height = std::min(static_cast<int32_t>(OVERLAY_SIZE), static_cast<int32_t>(target.swapChainExtent.height) - OVERLAY_MARGIN);
+        if (width <= 0 || height <= 0) {
+            return;
         }
+
+        VkImageBlit blit{};
+        blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.srcSubresource.layerCount = 1;
+        blit.srcOffsets[1] = {width, height, 1};
+        blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.dstSubresource.layerCount = 1;
+        blit.dstOffsets[0] = {OVERLAY_MARGIN, OVERLAY_MARGIN, 0};
+        blit.dstOffsets[1] = {OVERLAY_MARGIN + width, OVERLAY_MARGIN + height, 1};
+
+        vkCmdBlitImage(commandBuffer,
+            target.frameGraph.getImage(target.overlay), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            target.frameGraph.getImage(target.backbuffer), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            1, &blit, VK_FILTER_NEAREST);
     }
 
     void createSyncObjects() {
-        imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
         renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+        computeFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
         inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
 
         VkSemaphoreCreateInfo semaphoreInfo{};
@@ -710,40 +2357,88 @@ private:
         fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
         for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
-                vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
-                vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
+            if (vkCreateSemaphore(device, &semaphoreInfo, allocator, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
+                vkCreateSemaphore(device, &semaphoreInfo, allocator, &computeFinishedSemaphores[i]) != VK_SUCCESS ||
+                vkCreateFence(device, &fenceInfo, allocator, &inFlightFences[i]) != VK_SUCCESS) {
                 throw std::runtime_error("failed to create synchronization objects for a frame!");
             }
+
+            for (auto& target : targets) {
+                if (vkCreateSemaphore(device, &semaphoreInfo, allocator, &target->imageAvailableSemaphores[i]) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create synchronization objects for a frame!");
+                }
+            }
         }
     }
 
     void drawFrame() {
         vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+        frameCapture.frameCompleted(currentFrame); // the readback recorded with this fence has landed
+        textureStreamer.frameCompleted(currentFrame);
+        updateRenderScale();
+
+        // A minimized window, or one whose swapchain is out of date (it is recreated), sits
+        // this frame out; the others still render and present.
+        std::array<PresentTarget*, MAX_WINDOWS> frameTargets{};
+        uint32_t frameTargetCount = 0;
+        for (auto& target : targets) {
+            if (!options.headless && (target->framebufferWidth == 0 || target->framebufferHeight == 0)) {
+                continue;
+            }
+            if (target->swapChainStale) {
+                recreateSwapChain(*target); // restored since
+            }
 
-        uint32_t imageIndex;
-        VkResult result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+            VkResult result = vkAcquireNextImageKHR(device, target->swapChain, UINT64_MAX, target->imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &target->imageIndex);
 
-        if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-            recreateSwapChain();
+            if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+                recreateSwapChain(*target);
+                continue;
+            } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+                throw std::runtime_error("failed to acquire swap chain image!");
+            }
+            frameTargets[frameTargetCount++] = target.get();
+        }
+
+        if (frameTargetCount == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10)); // all minimized or just recreated
             return;
-        } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
-            throw std::runtime_error("failed to acquire swap chain image!");
         }
 
         vkResetFences(device, 1, &inFlightFences[currentFrame]);
 
+        for (uint32_t i = 0; i < frameTargetCount; i++) {
+            bindFrameImages(*frameTargets[i]);
+        }
+
+        // Kick the async compute work first so it overlaps the graphics recording and submission.
+        VkPipelineStageFlags computeWaitStage = submitAsyncCompute(frameTargets, frameTargetCount);
+
         vkResetCommandBuffer(commandBuffers[currentFrame], /*VkCommandBufferResetFlagBits*/ 0);
-        recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+        recordCommandBuffer(commandBuffers[currentFrame], frameTargets, frameTargetCount);
 
         VkSubmitInfo submitInfo{};
         submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-        VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
-        VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-        submitInfo.waitSemaphoreCount = 1;
-        submitInfo.pWaitSemaphores = waitSemaphores;
-        submitInfo.pWaitDstStageMask = waitStages;
+        std::array<VkSemaphore, MAX_WINDOWS + 2> waitSemaphores{};
+        std::array<VkPipelineStageFlags, MAX_WINDOWS + 2> waitStages{};
+        uint32_t waitCount = 0;
+        for (uint32_t i = 0; i < frameTargetCount; i++) {
+            waitSemaphores[waitCount] = frameTargets[i]->imageAvailableSemaphores[currentFrame];
+            waitStages[waitCount++] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        }
+        if (computeWaitStage != 0) {
+            waitSemaphores[waitCount] = computeFinishedSemaphores[currentFrame];
+            waitStages[waitCount++] = computeWaitStage;
+        }
+        VkSemaphore uploadSemaphore = useTextureStreaming ? textureStreamer.getUploadSemaphore(currentFrame) : VK_NULL_HANDLE;
+        if (uploadSemaphore != VK_NULL_HANDLE) {
+            waitSemaphores[waitCount] = uploadSemaphore;
+            waitStages[waitCount++] = TextureStreamer::UPLOAD_WAIT_STAGE;
+        }
+        submitInfo.waitSemaphoreCount = waitCount;
+        submitInfo.pWaitSemaphores = waitSemaphores.data();
+        submitInfo.pWaitDstStageMask = waitStages.data();
 
         submitInfo.commandBufferCount = 1;
         submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
@@ -756,27 +2451,54 @@ private:
             throw std::runtime_error("failed to submit draw command buffer!");
         }
 
+        // One present for all swapchains: the semaphore covers every target's rendering and
+        // the results come back per swapchain.
+        std::array<VkSwapchainKHR, MAX_WINDOWS> swapChains{};
+        std::array<uint32_t, MAX_WINDOWS> imageIndices{};
+        std::array<VkResult, MAX_WINDOWS> results{};
+        std::array<uint64_t, MAX_WINDOWS> presentIds{};
+        for (uint32_t i = 0; i < frameTargetCount; i++) {
+            swapChains[i] = frameTargets[i]->swapChain;
+            imageIndices[i] = frameTargets[i]->imageIndex;
+            presentIds[i] = presentId + 1;
+        }
+
         VkPresentInfoKHR presentInfo{};
         presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
         presentInfo.waitSemaphoreCount = 1;
         presentInfo.pWaitSemaphores = signalSemaphores;
 
-        VkSwapchainKHR swapChains[] = {swapChain};
-        presentInfo.swapchainCount = 1;
-        presentInfo.pSwapchains = swapChains;
-
-        presentInfo.pImageIndices = &imageIndex;
-
-        result = vkQueuePresentKHR(presentQueue, &presentInfo);
+        presentInfo.swapchainCount = frameTargetCount;
+        presentInfo.pSwapchains = swapChains.data();
+        presentInfo.pImageIndices = imageIndices.data();
+        presentInfo.pResults = results.data();
+
+        VkPresentIdKHR presentIdInfo{};
+        presentIdInfo.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+        presentIdInfo.swapchainCount = frameTargetCount;
+        presentIdInfo.pPresentIds = presentIds.data();
+        if (usePresentWait) {
+            presentInfo.pNext = &presentIdInfo;
+            presentId++;
+        }
 
-        if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized) {
-            framebufferResized = false;
-            recreateSwapChain();
-        } else if (result != VK_SUCCESS) {
+        VkResult result = vkQueuePresentKHR(presentQueue, &presentInfo);
+        pacingTarget = frameTargets[0];
+        if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR && result != VK_ERROR_OUT_OF_DATE_KHR) {
             throw std::runtime_error("failed to present swap chain image!");
         }
 
+        for (uint32_t i = 0; i < frameTargetCount; i++) {
+            bool resized = frameTargets[i]->framebufferResized.exchange(false);
+            if (results[i] == VK_ERROR_OUT_OF_DATE_KHR || results[i] == VK_SUBOPTIMAL_KHR || resized) {
+                recreateSwapChain(*frameTargets[i]);
+            } else if (results[i] != VK_SUCCESS) {
+                throw std::runtime_error("failed to present swap chain image!");
+            }
+        }
+
+        framesRendered++;
         currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
     }
 
@@ -787,21 +2509,40 @@ private:
         createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
 
         VkShaderModule shaderModule;
-        if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
+        if (vkCreateShaderModule(device, &createInfo, allocator, &shaderModule) != VK_SUCCESS) {
             throw std::runtime_error("failed to create shader module!");
         }
 
         return shaderModule;
     }
 
-    VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats) {
-        for (const auto& availableFormat : availableFormats) {
-            if (availableFormat.format == VK_FORMAT_B8G8R8A8_SRGB && availableFormat.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
-                return availableFormat;
+    // One pipeline renders to every window, so all swapchains share a format: the preferred
+    // one if every surface supports it, else the first of the primary surface's formats that
+    // the others support too. Picked once, so recreating a swapchain never changes it.
+    void chooseSwapSurfaceFormat() {
+        for (auto& target : targets) {
+            querySwapChainSupport(physicalDevice, target->surface, target->swapChainSupport);
+        }
+        auto supportedEverywhere = [this](const VkSurfaceFormatKHR& format) {
+            return std::all_of(targets.begin(), targets.end(), [&format](const auto& target) {
+                return std::any_of(target->swapChainSupport.formats.begin(), target->swapChainSupport.formats.end(), [&format](const VkSurfaceFormatKHR& available) {
+                    return available.format == format.format && available.colorSpace == format.colorSpace;
+                });
+            });
+        };
+
+        VkSurfaceFormatKHR chosen{VK_FORMAT_B8G8R8A8_SRGB, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR};
+        if (!supportedEverywhere(chosen)) {
+            const std::vector<VkSurfaceFormatKHR>& primaryFormats = targets[0]->swapChainSupport.formats;
+            auto found = std::find_if(primaryFormats.begin(), primaryFormats.end(), supportedEverywhere);
+            if (found == primaryFormats.end()) {
+                throw std::runtime_error("failed to find a surface format that every window supports!");
             }
+            chosen = *found;
         }
 
-        return availableFormats[0];
+        swapChainImageFormat = chosen.format;
+        swapChainColorSpace = chosen.colorSpace;
     }
 
     VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes) {
@@ -814,12 +2555,16 @@ private:
         return VK_PRESENT_MODE_FIFO_KHR;
     }
 
-    VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities) {
+    VkExtent2D chooseSwapExtent(const PresentTarget& target, const VkSurfaceCapabilitiesKHR& capabilities) {
         if (capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max()) {
             return capabilities.currentExtent;
         } else {
-            int width, height;
-            glfwGetFramebufferSize(window, &width, &height);
+            // A headless surface has no size of its own; render at the default window size.
+            int width = WIDTH, height = HEIGHT;
+            if (!options.headless) {
+                width = target.framebufferWidth;
+                height = target.framebufferHeight;
+            }
 
             VkExtent2D actualExtent = {
                 static_cast<uint32_t>(width),
@@ -833,28 +2578,26 @@ private:
         }
     }
 
-    SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device) {
-        SwapChainSupportDetails details;
-
+    // Fills details in place so that repeated queries (every swapchain recreation) reuse
+    // the vectors' storage.
+    void querySwapChainSupport(VkPhysicalDevice device, VkSurfaceKHR surface, SwapChainSupportDetails& details) {
         vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &details.capabilities);
 
         uint32_t formatCount;
         vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, nullptr);
 
+        details.formats.resize(formatCount);
         if (formatCount != 0) {
-            details.formats.resize(formatCount);
             vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, details.formats.data());
         }
 
         uint32_t presentModeCount;
         vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, nullptr);
 
+        details.presentModes.resize(presentModeCount);
         if (presentModeCount != 0) {
-            details.presentModes.resize(presentModeCount);
             vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, details.presentModes.data());
         }
-
-        return details;
     }
 
     bool isDeviceSuitable(VkPhysicalDevice device) {
@@ -862,29 +2605,51 @@ private:
 
         bool extensionsSupported = checkDeviceExtensionSupport(device);
 
-        bool swapChainAdequate = false;
-        if (extensionsSupported) {
-            SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
-            swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
+        bool swapChainAdequate = extensionsSupported;
+        for (const auto& target : targets) {
+            if (!swapChainAdequate) {
+                break;
+            }
+            querySwapChainSupport(device, target->surface, deviceSwapChainSupport);
+            swapChainAdequate = !deviceSwapChainSupport.formats.empty() && !deviceSwapChainSupport.presentModes.empty();
         }
 
         return indices.isComplete() && extensionsSupported && swapChainAdequate;
     }
 
-    bool checkDeviceExtensionSupport(VkPhysicalDevice device) {
+    bool isDeviceExtensionAvailable(VkPhysicalDevice device, const char* extensionName) {
         uint32_t extensionCount;
         vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
 
         std::vector<VkExtensionProperties> availableExtensions(extensionCount);
         vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
 
-        std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
-
         for (const auto& extension : availableExtensions) {
-            requiredExtensions.erase(extension.extensionName);
+            if (strcmp(extension.extensionName, extensionName) == 0) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool checkDeviceExtensionSupport(VkPhysicalDevice device) {
+        uint32_t extensionCount;
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+        for (const char* required : deviceExtensions) {
+            bool found = std::any_of(availableExtensions.begin(), availableExtensions.end(), [required](const VkExtensionProperties& extension) {
+                return strcmp(extension.extensionName, required) == 0;
+            });
+            if (!found) {
+                return false;
+            }
         }
 
-        return requiredExtensions.empty();
+        return true;
     }
 
     QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device) {
@@ -896,39 +2661,80 @@ private:
         std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
         vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
 
+        // Walk every family instead of stopping at the first match: dedicated compute
+        // and transfer families usually come after the graphics one.
+        std::optional<uint32_t> transferWithCompute;
+        bool graphicsHasCompute = false;
         uint32_t i = 0;
         for (const auto& queueFamily : queueFamilies) {
-            if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-                indices.graphicsFamily = i;
+            bool graphics = queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT;
+            bool compute = queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT;
+            bool transfer = queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT;
+
+            // All windows are presented with one vkQueuePresentKHR, so one family has to support every surface.
+            bool presentSupport = true;
+            for (const auto& target : targets) {
+                VkBool32 surfaceSupport = false;
+                vkGetPhysicalDeviceSurfaceSupportKHR(device, i, target->surface, &surfaceSupport);
+                presentSupport = presentSupport && surfaceSupport;
             }
 
-            VkBool32 presentSupport = false;
-            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+            // Prefer a graphics family that can run compute too, async passes fall back to it.
+            if (graphics && (!indices.graphicsFamily.has_value() || (compute && !graphicsHasCompute))) {
+                indices.graphicsFamily = i;
+                graphicsHasCompute = compute;
+            }
 
-            if (presentSupport) {
+            // Prefer presenting from the graphics family to avoid a concurrent swapchain.
+            if (presentSupport && (!indices.presentFamily.has_value() || (graphics && indices.presentFamily != indices.graphicsFamily))) {
                 indices.presentFamily = i;
             }
 
-            if (indices.isComplete()) {
-                break;
+            if (compute && !graphics && !indices.computeFamily.has_value()) {
+                indices.computeFamily = i;
+            }
+
+            if (transfer && !graphics && !compute && !indices.transferFamily.has_value()) {
+                indices.transferFamily = i;
+            } else if (transfer && !graphics && !transferWithCompute.has_value()) {
+                transferWithCompute = i;
             }
 
             i++;
         }
 
+        // Graphics families need not support compute. Without a compute-only family the
+        // async passes run inline, so the graphics family has to; otherwise the device is
+        // not suitable (isComplete()).
+        if (!indices.computeFamily.has_value() && graphicsHasCompute) {
+            indices.computeFamily = indices.graphicsFamily;
+        }
+        // Graphics families always support transfers, whether they advertise it or not.
+        if (!indices.transferFamily.has_value()) {
+            indices.transferFamily = transferWithCompute.has_value() ? transferWithCompute : indices.graphicsFamily;
+        }
+
         return indices;
     }
 
     std::vector<const char*> getRequiredExtensions() {
-        uint32_t glfwExtensionCount = 0;
-        const char** glfwExtensions;
-        glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        std::vector<const char*> extensions;
+        if (options.headless) {
+            extensions = {VK_KHR_SURFACE_EXTENSION_NAME, VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME};
+        } else {
+            uint32_t glfwExtensionCount = 0;
+            const char** glfwExtensions;
+            glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
-        std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+            extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+        }
 
         if (enableValidationLayers) {
             extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
         }
+        if (options.validationMode == ValidationMode::Synchronization) {
+            extensions.push_back(VK_EXT_VALIDATION_FEATURES_EXTENSION_NAME); // provided by the validation layer
+        }
 
         return extensions;
     }
@@ -975,18 +2781,11 @@ private:
 
         return buffer;
     }
-
-    static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback([[maybe_unused]] VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, [[maybe_unused]] VkDebugUtilsMessageTypeFlagsEXT messageType, const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData, [[maybe_unused]] void* pUserData) {
-        std::cerr << "validation layer: " << pCallbackData->pMessage << std::endl;
-
-        return VK_FALSE;
-    }
 };
 
-int main() {
-    HelloTriangleApplication app;
-
+int main(int argc, char** argv) {
     try {
+        HelloTriangleApplication app(parseOptions(argc, argv));
         app.run();
     } catch (const std::exception& e) {
         std::cerr << e.what() << std::endl;
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+
+// Layout of the .mesh files written by tools/meshconv and read by MeshFile. Everything is
+// little endian and stored exactly as the GPU consumes it, so loading is a bounds check
+// and one copy per section.
+//
+// Vertices are quantized to 16 bytes (MeshVertex), indices are in vertex cache optimized
+// order and the vertices in the order the indices first use them. The triangles are also
+// split into meshlets of at most MESHLET_MAX_VERTICES vertices and MESHLET_MAX_TRIANGLES
+// triangles, for mesh shaders or cluster culling.
+
+const uint32_t MESH_FILE_MAGIC = 0x48534d54; // "TMSH"
+const uint32_t MESH_FILE_VERSION = 1;
+
+// Sections start at multiples of this in the file, the largest minStorageBufferOffsetAlignment
+// a device may have: loaded into one buffer, every section can be bound on its own.
+const uint32_t MESH_SECTION_ALIGNMENT = 256;
+
+const uint32_t MESHLET_MAX_VERTICES = 64;
+const uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+enum MeshSection : uint32_t {
+    MESH_SECTION_VERTICES = 0,          // MeshVertex[vertexCount]
+    MESH_SECTION_INDICES = 1,           // uint16_t or uint32_t[indexCount], see MESH_FLAG_32BIT_INDICES
+    MESH_SECTION_MESHLETS = 2,          // MeshMeshlet[meshletCount]
+    MESH_SECTION_MESHLET_VERTICES = 3,  // uint32_t vertex indices, referenced by MeshMeshlet::vertexOffset
+    MESH_SECTION_MESHLET_TRIANGLES = 4, // uint8_t triples of meshlet-local vertex indices
+    MESH_SECTION_COUNT = 5
+};
+
+enum MeshFlags : uint32_t {
+    MESH_FLAG_32BIT_INDICES = 1
+};
+
+struct MeshFileSection {
+    uint64_t offset; // from the start of the file
+    uint64_t size;
+};
+
+struct MeshFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t flags;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t meshletCount;
+    // Positions are quantized relative to this box.
+    float boundsMin[3];
+    float boundsMax[3];
+    MeshFileSection sections[MESH_SECTION_COUNT];
+};
+
+// position: R16G16B16A16_UNORM, scaled to the bounds (w is unused)
+// normal: R16G16_SNORM, octahedral encoding
+// uv: R16G16_SFLOAT
+struct MeshVertex {
+    uint16_t position[4];
+    int16_t normal[2];
+    uint16_t uv[2];
+};
+
+struct MeshMeshlet {
+    uint32_t vertexOffset;   // into the meshlet vertices
+    uint32_t triangleOffset; // into the meshlet triangles, in bytes
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+    float center[3];         // bounding sphere, in model space
+    float radius;
+};
+
+static_assert(sizeof(MeshFileHeader) == 128);
+static_assert(sizeof(MeshVertex) == 16);
+static_assert(sizeof(MeshMeshlet) == 32);
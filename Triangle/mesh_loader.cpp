@@ -0,0 +1,272 @@
+#include "mesh_loader.hpp"
+#include "vulkan_memory.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+
+namespace {
+
+// Read-only mapping of a whole file, unmapped when it goes out of scope.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& filename)
+        : data(nullptr)
+        , size(0)
+    {
+        int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw std::runtime_error("failed to open " + filename + "!");
+        }
+        struct stat fileStat;
+        if (fstat(fd, &fileStat) != 0 || fileStat.st_size < static_cast<off_t>(sizeof(MeshFileHeader))) {
+            close(fd);
+            throw std::runtime_error(filename + " is not a mesh file!");
+        }
+        size = static_cast<size_t>(fileStat.st_size);
+        void* memory = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (memory == MAP_FAILED) {
+            throw std::runtime_error("failed to map " + filename + "!");
+        }
+        data = static_cast<const std::byte*>(memory);
+        // Read once, front to back: let the kernel read ahead aggressively.
+        madvise(memory, size, MADV_SEQUENTIAL);
+        madvise(memory, size, MADV_WILLNEED);
+    }
+
+    ~MappedFile() {
+        munmap(const_cast<std::byte*>(data), size);
+    }
+
+    MappedFile(const MappedFile& source) = delete;
+    MappedFile& operator=(const MappedFile& source) = delete;
+
+    const std::byte* data;
+    size_t size;
+};
+
+void checkSection(const std::string& filename, const MeshFileHeader& header, size_t fileSize, MeshSection section, uint64_t expectedSize) {
+    const MeshFileSection& entry = header.sections[section];
+    if (entry.offset % MESH_SECTION_ALIGNMENT != 0 || entry.offset > fileSize || entry.size > fileSize - entry.offset || entry.size != expectedSize) {
+        throw std::runtime_error(filename + " has a broken section " + std::to_string(section) + "!");
+    }
+}
+
+VkBuffer createBuffer(VkDevice device, VkDeviceSize size, VkBufferUsageFlags usage, const VkAllocationCallbacks* allocator) {
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = usage;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VkBuffer buffer;
+    if (vkCreateBuffer(device, &bufferInfo, allocator, &buffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create mesh buffer!");
+    }
+    return buffer;
+}
+
+// VK_NULL_HANDLE if there is no memory type with the properties, or it is out of memory.
+VkDeviceMemory allocateBufferMemory(VkDevice device, VkPhysicalDevice physicalDevice, VkBuffer buffer, VkMemoryPropertyFlags properties, const VkAllocationCallbacks* allocator) {
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+
+    std::optional<uint32_t> memoryType = findMemoryType(physicalDevice, memRequirements.memoryTypeBits, properties);
+    if (!memoryType.has_value()) {
+        return VK_NULL_HANDLE;
+    }
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = memoryType.value();
+
+    VkDeviceMemory memory;
+    if (vkAllocateMemory(device, &allocInfo, allocator, &memory) != VK_SUCCESS) {
+        return VK_NULL_HANDLE;
+    }
+    vkBindBufferMemory(device, buffer, memory, 0);
+    return memory;
+}
+
+void copyToMemory(VkDevice device, VkDeviceMemory memory, const std::byte* data, VkDeviceSize size) {
+    void* mapped = nullptr;
+    if (vkMapMemory(device, memory, 0, size, 0, &mapped) != VK_SUCCESS) {
+        throw std::runtime_error("failed to map mesh memory!");
+    }
+    std::memcpy(mapped, data, static_cast<size_t>(size));
+    vkUnmapMemory(device, memory);
+}
+
+VkCommandBuffer beginOneTimeCommands(VkDevice device, VkCommandPool commandPool) {
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer;
+    if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate mesh upload command buffer!");
+    }
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    return commandBuffer;
+}
+
+void submitAndWait(VkDevice device, VkCommandPool commandPool, VkQueue queue, VkCommandBuffer commandBuffer) {
+    vkEndCommandBuffer(commandBuffer);
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+
+    // Loading happens before the first frame; waiting for the queue is the simplest fence.
+    VkResult result = vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
+    if (result == VK_SUCCESS) {
+        result = vkQueueWaitIdle(queue);
+    }
+    vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("failed to upload mesh!");
+    }
+}
+
+// Copies on the transfer queue. With a family of its own, the copy releases the buffer to
+// the graphics family, which acquires it in a second submission; the wait for the first
+// one orders the two.
+void copyBuffer(VkDevice device, const MeshUploadQueues& queues, VkBuffer source, VkBuffer destination, VkDeviceSize size) {
+    bool transferOwnership = queues.transferFamily != queues.graphicsFamily;
+
+    VkBufferMemoryBarrier ownership{};
+    ownership.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    ownership.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    ownership.dstAccessMask = 0;
+    ownership.srcQueueFamilyIndex = queues.transferFamily;
+    ownership.dstQueueFamilyIndex = queues.graphicsFamily;
+    ownership.buffer = destination;
+    ownership.offset = 0;
+    ownership.size = VK_WHOLE_SIZE;
+
+    VkCommandBuffer commandBuffer = beginOneTimeCommands(device, queues.transferCommandPool);
+    VkBufferCopy region{};
+    region.size = size;
+    vkCmdCopyBuffer(commandBuffer, source, destination, 1, &region);
+    if (transferOwnership) {
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+            0, nullptr, 1, &ownership, 0, nullptr);
+    }
+    submitAndWait(device, queues.transferCommandPool, queues.transferQueue, commandBuffer);
+
+    if (!transferOwnership) {
+        return;
+    }
+    ownership.srcAccessMask = 0;
+    ownership.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+    commandBuffer = beginOneTimeCommands(device, queues.graphicsCommandPool);
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0,
+        0, nullptr, 1, &ownership, 0, nullptr);
+    submitAndWait(device, queues.graphicsCommandPool, queues.graphicsQueue, commandBuffer);
+}
+
+} // namespace
+
+GpuMesh loadMesh(const std::string& filename, VkDevice device, VkPhysicalDevice physicalDevice, const VkAllocationCallbacks* allocator,
+    const MeshUploadQueues& queues) {
+    MappedFile file(filename);
+
+    MeshFileHeader header;
+    std::memcpy(&header, file.data, sizeof(header));
+    if (header.magic != MESH_FILE_MAGIC) {
+        throw std::runtime_error(filename + " is not a mesh file!");
+    }
+    if (header.version != MESH_FILE_VERSION) {
+        throw std::runtime_error(filename + " has version " + std::to_string(header.version) + ", expected " + std::to_string(MESH_FILE_VERSION) + "; convert it again!");
+    }
+
+    bool indices32 = header.flags & MESH_FLAG_32BIT_INDICES;
+    uint64_t meshletVertexCount = header.sections[MESH_SECTION_MESHLET_VERTICES].size / sizeof(uint32_t);
+    checkSection(filename, header, file.size, MESH_SECTION_VERTICES, uint64_t{header.vertexCount} * sizeof(MeshVertex));
+    checkSection(filename, header, file.size, MESH_SECTION_INDICES, uint64_t{header.indexCount} * (indices32 ? 4 : 2));
+    checkSection(filename, header, file.size, MESH_SECTION_MESHLETS, uint64_t{header.meshletCount} * sizeof(MeshMeshlet));
+    checkSection(filename, header, file.size, MESH_SECTION_MESHLET_VERTICES, meshletVertexCount * sizeof(uint32_t));
+    checkSection(filename, header, file.size, MESH_SECTION_MESHLET_TRIANGLES, header.sections[MESH_SECTION_MESHLET_TRIANGLES].size);
+
+    // The sections go into the buffer as one block, from the first to the end of the last.
+    uint64_t blockStart = file.size;
+    uint64_t blockEnd = 0;
+    for (const MeshFileSection& section : header.sections) {
+        blockStart = std::min(blockStart, section.offset);
+        blockEnd = std::max(blockEnd, section.offset + section.size);
+    }
+
+    GpuMesh mesh;
+    mesh.size = std::max<VkDeviceSize>(blockEnd - blockStart, MESH_SECTION_ALIGNMENT);
+    for (uint32_t section = 0; section < MESH_SECTION_COUNT; section++) {
+        mesh.sectionOffsets[section] = header.sections[section].offset - blockStart;
+        mesh.sectionSizes[section] = header.sections[section].size;
+    }
+    mesh.indexType = indices32 ? VK_INDEX_TYPE_UINT32 : VK_INDEX_TYPE_UINT16;
+    mesh.vertexCount = header.vertexCount;
+    mesh.indexCount = header.indexCount;
+    mesh.meshletCount = header.meshletCount;
+    std::copy(std::begin(header.boundsMin), std::end(header.boundsMin), mesh.boundsMin.begin());
+    std::copy(std::begin(header.boundsMax), std::end(header.boundsMax), mesh.boundsMax.begin());
+
+    const std::byte* data = file.data + blockStart;
+    VkDeviceSize dataSize = blockEnd - blockStart;
+    VkBufferUsageFlags usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+
+    mesh.buffer = createBuffer(device, mesh.size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, allocator);
+    mesh.memory = allocateBufferMemory(device, physicalDevice, mesh.buffer,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, allocator);
+    if (mesh.memory != VK_NULL_HANDLE) {
+        copyToMemory(device, mesh.memory, data, dataSize);
+        return mesh;
+    }
+
+    // Host visible device memory is missing or full (without resizable BAR it is a 256 MiB window).
+    mesh.staged = true;
+    mesh.memory = allocateBufferMemory(device, physicalDevice, mesh.buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, allocator);
+    if (mesh.memory == VK_NULL_HANDLE) {
+        vkDestroyBuffer(device, mesh.buffer, allocator);
+        throw std::runtime_error("failed to allocate mesh memory!");
+    }
+
+    VkBuffer stagingBuffer = createBuffer(device, dataSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, allocator);
+    VkDeviceMemory stagingMemory = allocateBufferMemory(device, physicalDevice, stagingBuffer,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, allocator);
+    try {
+        if (stagingMemory == VK_NULL_HANDLE) {
+            throw std::runtime_error("failed to allocate mesh staging memory!");
+        }
+        copyToMemory(device, stagingMemory, data, dataSize);
+        copyBuffer(device, queues, stagingBuffer, mesh.buffer, dataSize);
+    } catch (...) {
+        vkDestroyBuffer(device, stagingBuffer, allocator);
+        vkFreeMemory(device, stagingMemory, allocator);
+        destroyMesh(device, mesh, allocator);
+        throw;
+    }
+    vkDestroyBuffer(device, stagingBuffer, allocator);
+    vkFreeMemory(device, stagingMemory, allocator);
+
+    return mesh;
+}
+
+void destroyMesh(VkDevice device, GpuMesh& mesh, const VkAllocationCallbacks* allocator) {
+    vkDestroyBuffer(device, mesh.buffer, allocator);
+    vkFreeMemory(device, mesh.memory, allocator);
+    mesh = GpuMesh();
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "mesh_format.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+// A mesh file loaded into one device local buffer: the file's sections back to back at the
+// same relative offsets, usable as vertex, index and storage buffer.
+struct GpuMesh {
+    VkBuffer buffer;
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    std::array<VkDeviceSize, MESH_SECTION_COUNT> sectionOffsets; // in buffer
+    std::array<VkDeviceSize, MESH_SECTION_COUNT> sectionSizes;
+    VkIndexType indexType;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t meshletCount;
+    std::array<float, 3> boundsMin; // dequantizes MeshVertex::position
+    std::array<float, 3> boundsMax;
+    bool staged; // went through a staging buffer rather than straight into device memory
+    GpuMesh()
+        : buffer(VK_NULL_HANDLE)
+        , memory(VK_NULL_HANDLE)
+        , size(0)
+        , sectionOffsets()
+        , sectionSizes()
+        , indexType(VK_INDEX_TYPE_UINT16)
+        , vertexCount(0)
+        , indexCount(0)
+        , meshletCount(0)
+        , boundsMin()
+        , boundsMax()
+        , staged(false)
+    {}
+};
+
+// Where a staged mesh is copied, and the graphics queue that draws it; each command pool
+// belongs to its queue's family.
+struct MeshUploadQueues {
+    VkQueue transferQueue;
+    uint32_t transferFamily;
+    VkCommandPool transferCommandPool;
+    VkQueue graphicsQueue;
+    uint32_t graphicsFamily;
+    VkCommandPool graphicsCommandPool;
+    MeshUploadQueues(
+        VkQueue transferQueue = VK_NULL_HANDLE,
+        uint32_t transferFamily = 0,
+        VkCommandPool transferCommandPool = VK_NULL_HANDLE,
+        VkQueue graphicsQueue = VK_NULL_HANDLE,
+        uint32_t graphicsFamily = 0,
+        VkCommandPool graphicsCommandPool = VK_NULL_HANDLE)
+        : transferQueue(transferQueue)
+        , transferFamily(transferFamily)
+        , transferCommandPool(transferCommandPool)
+        , graphicsQueue(graphicsQueue)
+        , graphicsFamily(graphicsFamily)
+        , graphicsCommandPool(graphicsCommandPool)
+    {}
+};
+
+// Maps a file written by tools/meshconv, checks that its header and sections are
+// consistent, and copies the sections into a new buffer without looking at their
+// contents. Where the device has memory that is both device local and host visible
+// (integrated GPUs, resizable BAR) the copy goes straight into it; otherwise through a
+// staging buffer and a transfer on the transfer queue, which is waited for. The buffer
+// is owned by the graphics family either way.
+GpuMesh loadMesh(const std::string& filename, VkDevice device, VkPhysicalDevice physicalDevice, const VkAllocationCallbacks* allocator,
+    const MeshUploadQueues& queues);
+void destroyMesh(VkDevice device, GpuMesh& mesh, const VkAllocationCallbacks* allocator);
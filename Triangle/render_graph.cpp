@@ -0,0 +1,694 @@
+#include "render_graph.hpp"
+#include "vulkan_memory.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+const VkAccessFlags WRITE_ACCESS_MASK =
+    VK_ACCESS_SHADER_WRITE_BIT |
+    VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+    VK_ACCESS_TRANSFER_WRITE_BIT |
+    VK_ACCESS_HOST_WRITE_BIT |
+    VK_ACCESS_MEMORY_WRITE_BIT;
+
+struct UsageInfo {
+    VkPipelineStageFlags stage;
+    VkAccessFlags access;
+    VkImageLayout layout;
+};
+
+UsageInfo usageInfo(RenderGraphUsage usage, bool write) {
+    const VkAccessFlags colorRead = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
+    const VkAccessFlags colorWrite = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    const VkAccessFlags depthRead = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+    const VkAccessFlags depthWrite = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    const VkAccessFlags shaderRead = VK_ACCESS_SHADER_READ_BIT;
+    const VkAccessFlags shaderWrite = VK_ACCESS_SHADER_WRITE_BIT;
+
+    switch (usage) {
+        case RenderGraphUsage::ColorAttachment:
+            return {
+                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                write ? colorRead | colorWrite : colorRead,
+                VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+            };
+        case RenderGraphUsage::DepthStencilAttachment:
+            return {
+                VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                write ? depthRead | depthWrite : depthRead,
+                VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+            };
+        case RenderGraphUsage::FragmentShaderSampled:
+            if (write) {
+                throw std::runtime_error("render graph: sampled images cannot be written!");
+            }
+            return {VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+        case RenderGraphUsage::ComputeShaderSampled:
+            if (write) {
+                throw std::runtime_error("render graph: sampled images cannot be written!");
+            }
+            return {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+        case RenderGraphUsage::ComputeStorage:
+            return {
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                write ? shaderRead | shaderWrite : shaderRead,
+                VK_IMAGE_LAYOUT_GENERAL
+            };
+        case RenderGraphUsage::TransferSrc:
+            if (write) {
+                throw std::runtime_error("render graph: transfer sources cannot be written!");
+            }
+            return {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL};
+        case RenderGraphUsage::TransferDst:
+            if (!write) {
+                throw std::runtime_error("render graph: transfer destinations cannot be read!");
+            }
+            return {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL};
+    }
+
+    throw std::runtime_error("render graph: unknown resource usage!");
+}
+
+} // namespace
+
+RenderGraph::RenderGraph()
+    : resources()
+    , passes()
+    , executionOrder()
+    , memorySlots()
+    , finalBarriers()
+    , graphicsFamily(VK_QUEUE_FAMILY_IGNORED)
+    , asyncComputeFamily(VK_QUEUE_FAMILY_IGNORED)
+    , asyncComputeRelease()
+    , asyncComputeWaitStages(0)
+    , compiled(false)
+{}
+
+RenderGraphResource RenderGraph::importImage(const std::string& name, VkImageAspectFlags aspect, VkImageLayout initialLayout, VkPipelineStageFlags initialStage, VkImageLayout finalLayout) {
+    Resource resource{name, true, RenderGraphImageDesc(), aspect, initialLayout, initialStage, finalLayout, true, VK_NULL_HANDLE, VK_NULL_HANDLE, 0, 0, 0};
+    resources.push_back(resource);
+    return static_cast<RenderGraphResource>(resources.size() - 1);
+}
+
+RenderGraphResource RenderGraph::createImage(const std::string& name, const RenderGraphImageDesc& desc) {
+    Resource resource{name, false, desc, desc.aspect, VK_IMAGE_LAYOUT_UNDEFINED, 0, VK_IMAGE_LAYOUT_UNDEFINED, false, VK_NULL_HANDLE, VK_NULL_HANDLE, 0, 0, 0};
+    resources.push_back(resource);
+    return static_cast<RenderGraphResource>(resources.size() - 1);
+}
+
+RenderGraphPass RenderGraph::addPass(const std::string& name, ExecuteCallback execute, RenderGraphQueue queue) {
+    passes.push_back(Pass{name, std::move(execute), queue, {}, false, false, {}});
+    return static_cast<RenderGraphPass>(passes.size() - 1);
+}
+
+void RenderGraph::read(RenderGraphPass pass, RenderGraphResource resource, RenderGraphUsage usage) {
+    addAccess(pass, resource, usage, false);
+}
+
+void RenderGraph::write(RenderGraphPass pass, RenderGraphResource resource, RenderGraphUsage usage) {
+    addAccess(pass, resource, usage, true);
+}
+
+void RenderGraph::addAccess(RenderGraphPass pass, RenderGraphResource resource, RenderGraphUsage usage, bool write) {
+    if (compiled) {
+        throw std::runtime_error("render graph: cannot change a compiled graph!");
+    }
+    if (pass >= passes.size() || resource >= resources.size()) {
+        throw std::runtime_error("render graph: unknown pass or resource!");
+    }
+
+    usageInfo(usage, write); // rejects impossible combinations up front
+    passes[pass].accesses.push_back(Access{resource, usage, write});
+}
+
+void RenderGraph::markOutput(RenderGraphResource resource) {
+    resources.at(resource).output = true;
+}
+
+void RenderGraph::setSideEffects(RenderGraphPass pass) {
+    passes.at(pass).sideEffects = true;
+}
+
+void RenderGraph::setQueueFamilies(uint32_t graphicsFamily, uint32_t asyncComputeFamily) {
+    if (compiled) {
+        throw std::runtime_error("render graph: cannot change a compiled graph!");
+    }
+    this->graphicsFamily = graphicsFamily;
+    this->asyncComputeFamily = asyncComputeFamily;
+}
+
+void RenderGraph::compile(VkDevice device, VkPhysicalDevice physicalDevice, const VkAllocationCallbacks* allocator) {
+    if (compiled) {
+        throw std::runtime_error("render graph: graph is already compiled!");
+    }
+
+    sortPasses();
+    cullPasses();
+    scheduleAsyncCompute();
+    computeLifetimes();
+    allocateOwnedImages(device, physicalDevice, allocator);
+    buildBarriers();
+
+    compiled = true;
+}
+
+// Readers depend on every writer of what they read, and writers of the same image keep
+// their declaration order. Passes therefore do not have to be declared in execution order.
+void RenderGraph::sortPasses() {
+    std::vector<std::vector<RenderGraphPass>> dependents(passes.size());
+    std::vector<uint32_t> dependencyCount(passes.size(), 0);
+
+    auto addEdge = [&](RenderGraphPass from, RenderGraphPass to) {
+        if (from == to) {
+            return;
+        }
+        dependents[from].push_back(to);
+        dependencyCount[to]++;
+    };
+
+    for (RenderGraphResource r = 0; r < resources.size(); r++) {
+        std::vector<RenderGraphPass> writers;
+        std::vector<RenderGraphPass> readers;
+        for (RenderGraphPass p = 0; p < passes.size(); p++) {
+            bool writes = false;
+            bool reads = false;
+            for (const auto& access : passes[p].accesses) {
+                if (access.resource == r) {
+                    writes = writes || access.write;
+                    reads = reads || !access.write;
+                }
+            }
+            if (writes) {
+                writers.push_back(p);
+            } else if (reads) {
+                readers.push_back(p);
+            }
+        }
+
+        for (size_t i = 1; i < writers.size(); i++) {
+            addEdge(writers[i - 1], writers[i]);
+        }
+        for (RenderGraphPass reader : readers) {
+            for (RenderGraphPass writer : writers) {
+                addEdge(writer, reader);
+            }
+        }
+    }
+
+    // Kahn's algorithm, breaking ties by declaration order so the result is stable.
+    executionOrder.clear();
+    std::vector<bool> scheduled(passes.size(), false);
+    while (executionOrder.size() < passes.size()) {
+        bool progress = false;
+        for (RenderGraphPass p = 0; p < passes.size(); p++) {
+            if (scheduled[p] || dependencyCount[p] != 0) {
+                continue;
+            }
+            scheduled[p] = true;
+            executionOrder.push_back(p);
+            for (RenderGraphPass dependent : dependents[p]) {
+                dependencyCount[dependent]--;
+            }
+            progress = true;
+            break;
+        }
+        if (!progress) {
+            throw std::runtime_error("render graph: passes have a dependency cycle!");
+        }
+    }
+}
+
+// Walks the order backwards from everything that leaves the graph and keeps only the
+// passes that contribute to it.
+void RenderGraph::cullPasses() {
+    std::vector<bool> needed(resources.size(), false);
+    for (RenderGraphResource r = 0; r < resources.size(); r++) {
+        needed[r] = resources[r].imported || resources[r].output;
+    }
+
+    for (auto it = executionOrder.rbegin(); it != executionOrder.rend(); ++it) {
+        Pass& pass = passes[*it];
+
+        bool live = pass.sideEffects;
+        for (const auto& access : pass.accesses) {
+            live = live || (access.write && needed[access.resource]);
+        }
+
+        pass.culled = !live;
+        if (live) {
+            for (const auto& access : pass.accesses) {
+                // Writes to owned images that are not read-modify-write don't need older contents.
+                needed[access.resource] = needed[access.resource] || !access.write || access.usage == RenderGraphUsage::ColorAttachment || access.usage == RenderGraphUsage::DepthStencilAttachment;
+            }
+        }
+    }
+
+    executionOrder.erase(
+        std::remove_if(executionOrder.begin(), executionOrder.end(), [this](RenderGraphPass p) { return passes[p].culled; }),
+        executionOrder.end());
+}
+
+// Moves the async compute passes to the front, where the graphics passes consuming their
+// results can wait for them. Nothing may flow the other way within a frame, which would
+// take a second semaphore: no graphics pass may touch their images before them, and the
+// images must come in undefined (so they carry no other queue's contents either).
+void RenderGraph::scheduleAsyncCompute() {
+    std::vector<bool> touchedByGraphics(resources.size(), false);
+    for (RenderGraphPass p : executionOrder) {
+        const Pass& pass = passes[p];
+        bool async = runsAsync(pass);
+        for (const auto& access : pass.accesses) {
+            const Resource& resource = resources[access.resource];
+            if (!async) {
+                touchedByGraphics[access.resource] = true;
+            } else if (!resource.imported) {
+                throw std::runtime_error("render graph: async compute pass " + pass.name + " may only use imported images!");
+            } else if (resource.initialLayout != VK_IMAGE_LAYOUT_UNDEFINED || touchedByGraphics[access.resource]) {
+                throw std::runtime_error("render graph: async compute pass " + pass.name + " depends on the graphics queue through " + resource.name + "!");
+            }
+        }
+    }
+
+    std::stable_partition(executionOrder.begin(), executionOrder.end(), [this](RenderGraphPass p) { return runsAsync(passes[p]); });
+}
+
+void RenderGraph::computeLifetimes() {
+    const uint32_t unused = UINT32_MAX;
+    for (auto& resource : resources) {
+        resource.firstUse = unused;
+        resource.lastUse = 0;
+    }
+
+    for (uint32_t position = 0; position < executionOrder.size(); position++) {
+        for (const auto& access : passes[executionOrder[position]].accesses) {
+            Resource& resource = resources[access.resource];
+            resource.firstUse = std::min(resource.firstUse, position);
+            resource.lastUse = std::max(resource.lastUse, position);
+        }
+    }
+}
+
+// Owned images whose lifetimes don't overlap share one allocation. Every image is bound
+// at offset 0, so an allocation only has to be as large as its biggest occupant.
+void RenderGraph::allocateOwnedImages(VkDevice device, VkPhysicalDevice physicalDevice, const VkAllocationCallbacks* allocator) {
+    std::vector<RenderGraphResource> owned;
+    for (RenderGraphResource r = 0; r < resources.size(); r++) {
+        if (!resources[r].imported && resources[r].firstUse != UINT32_MAX) {
+            owned.push_back(r);
+        }
+    }
+    std::sort(owned.begin(), owned.end(), [this](RenderGraphResource a, RenderGraphResource b) {
+        return resources[a].firstUse < resources[b].firstUse;
+    });
+
+    std::vector<VkMemoryRequirements> requirements(resources.size());
+    for (RenderGraphResource r : owned) {
+        Resource& resource = resources[r];
+
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent.width = resource.desc.extent.width;
+        imageInfo.extent.height = resource.desc.extent.height;
+        imageInfo.extent.depth = 1;
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = resource.desc.format;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = resource.desc.usage;
+        imageInfo.samples = resource.desc.samples;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateImage(device, &imageInfo, allocator, &resource.image) != VK_SUCCESS) {
+            throw std::runtime_error("render graph: failed to create image " + resource.name + "!");
+        }
+
+        VkMemoryRequirements& memRequirements = requirements[r];
+        vkGetImageMemoryRequirements(device, resource.image, &memRequirements);
+
+        bool lazy = resource.desc.preferLazyMemory &&
+            findMemoryType(physicalDevice, memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT).has_value();
+
+        MemorySlot* slot = nullptr;
+        for (auto& candidate : memorySlots) {
+            if (candidate.lazy == lazy &&
+                (candidate.memoryTypeBits & memRequirements.memoryTypeBits) != 0 &&
+                resources[candidate.occupants.back()].lastUse < resource.firstUse) {
+                slot = &candidate;
+                break;
+            }
+        }
+        if (slot == nullptr) {
+            memorySlots.push_back(MemorySlot{VK_NULL_HANDLE, 0, memRequirements.memoryTypeBits, lazy, {}});
+            slot = &memorySlots.back();
+        }
+
+        slot->size = std::max(slot->size, memRequirements.size);
+        slot->memoryTypeBits &= memRequirements.memoryTypeBits;
+        slot->occupants.push_back(r);
+        resource.memorySlot = static_cast<uint32_t>(slot - memorySlots.data());
+    }
+
+    for (auto& slot : memorySlots) {
+        VkMemoryPropertyFlags properties = slot.lazy ? VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        std::optional<uint32_t> memoryType = findMemoryType(physicalDevice, slot.memoryTypeBits, properties);
+        if (!memoryType.has_value()) {
+            memoryType = findMemoryType(physicalDevice, slot.memoryTypeBits, 0);
+        }
+        if (!memoryType.has_value()) {
+            throw std::runtime_error("render graph: failed to find suitable memory type!");
+        }
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = slot.size;
+        allocInfo.memoryTypeIndex = memoryType.value();
+
+        if (vkAllocateMemory(device, &allocInfo, allocator, &slot.memory) != VK_SUCCESS) {
+            throw std::runtime_error("render graph: failed to allocate image memory!");
+        }
+
+        for (RenderGraphResource r : slot.occupants) {
+            Resource& resource = resources[r];
+            vkBindImageMemory(device, resource.image, slot.memory, 0);
+
+            VkImageViewCreateInfo viewInfo{};
+            viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            viewInfo.image = resource.image;
+            viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            viewInfo.format = resource.desc.format;
+            viewInfo.subresourceRange.aspectMask = resource.aspect;
+            viewInfo.subresourceRange.baseMipLevel = 0;
+            viewInfo.subresourceRange.levelCount = 1;
+            viewInfo.subresourceRange.baseArrayLayer = 0;
+            viewInfo.subresourceRange.layerCount = 1;
+
+            if (vkCreateImageView(device, &viewInfo, allocator, &resource.view) != VK_SUCCESS) {
+                throw std::runtime_error("render graph: failed to create image view for " + resource.name + "!");
+            }
+        }
+    }
+}
+
+void RenderGraph::buildBarriers() {
+    std::vector<ResourceState> initialStates(resources.size());
+    for (RenderGraphResource r = 0; r < resources.size(); r++) {
+        if (resources[r].imported) {
+            initialStates[r].layout = resources[r].initialLayout;
+            initialStates[r].writeStages = resources[r].initialStage;
+        }
+    }
+
+    // Owned images start every frame undefined, but must still wait for whatever touched
+    // their memory last: the previous occupant of the allocation, or (for the first
+    // occupant) the last occupant's work from the previous frame.
+    std::vector<ResourceState> endStates = simulate(initialStates, false);
+    for (const auto& slot : memorySlots) {
+        for (size_t i = 0; i < slot.occupants.size(); i++) {
+            RenderGraphResource previous = slot.occupants[i == 0 ? slot.occupants.size() - 1 : i - 1];
+            ResourceState& state = initialStates[slot.occupants[i]];
+            state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+            state.writeStages = endStates[previous].writeStages | endStates[previous].readStages;
+            state.writeAccess = endStates[previous].writeAccess;
+        }
+    }
+
+    asyncComputeWaitStages = 0;
+    simulate(initialStates, true);
+}
+
+std::vector<RenderGraph::ResourceState> RenderGraph::simulate(const std::vector<ResourceState>& initialStates, bool record) {
+    std::vector<ResourceState> states = initialStates;
+    BarrierBatch scratch;
+    BarrierBatch scratchRelease;
+    BarrierBatch& release = record ? asyncComputeRelease : scratchRelease;
+
+    for (RenderGraphPass p : executionOrder) {
+        Pass& pass = passes[p];
+        bool async = runsAsync(pass);
+        scratch.barriers.clear();
+        BarrierBatch& batch = record ? pass.before : scratch;
+        for (const auto& access : pass.accesses) {
+            UsageInfo info = usageInfo(access.usage, access.write);
+            ResourceState& state = states[access.resource];
+            if (state.asyncCompute && !async) {
+                transferToGraphics(release, batch, access.resource, state, info.stage, info.access, info.layout, access.write);
+            } else {
+                transition(batch, access.resource, state, info.stage, info.access, info.layout, access.write);
+                state.asyncCompute = async;
+            }
+        }
+    }
+
+    for (RenderGraphResource r = 0; r < resources.size(); r++) {
+        const Resource& resource = resources[r];
+        if (resource.imported && resource.finalLayout != VK_IMAGE_LAYOUT_UNDEFINED && resource.finalLayout != states[r].layout) {
+            scratch.barriers.clear();
+            // Images no graphics pass used are still the async compute queue's.
+            BarrierBatch& batch = states[r].asyncCompute ? release : (record ? finalBarriers : scratch);
+            transition(batch, r, states[r], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, resource.finalLayout, false);
+        }
+    }
+
+    if (record) {
+        for (auto& pass : passes) {
+            pass.before.recorded.resize(pass.before.barriers.size());
+        }
+        finalBarriers.recorded.resize(finalBarriers.barriers.size());
+        asyncComputeRelease.recorded.resize(asyncComputeRelease.barriers.size());
+    }
+
+    return states;
+}
+
+// Emits a barrier only when one is needed: on a layout change, before a write that
+// follows other accesses, or before the first read of a stage after a write.
+void RenderGraph::transition(BarrierBatch& batch, RenderGraphResource resource, ResourceState& state, VkPipelineStageFlags stage, VkAccessFlags access, VkImageLayout layout, bool write) {
+    bool layoutChange = state.layout != layout;
+    bool touched = state.writeStages != 0 || state.readStages != 0;
+
+    bool hazard;
+    if (write || layoutChange) {
+        hazard = layoutChange || touched;
+    } else {
+        hazard = state.writeStages != 0 && (state.readStages & stage) != stage;
+    }
+
+    if (hazard) {
+        VkPipelineStageFlags srcStage = state.writeStages;
+        if (write || layoutChange) {
+            srcStage |= state.readStages;
+        }
+        if (srcStage == 0) {
+            srcStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        }
+
+        batch.srcStageMask |= srcStage;
+        batch.dstStageMask |= stage;
+
+        auto existing = std::find_if(batch.barriers.begin(), batch.barriers.end(), [resource](const Barrier& b) { return b.resource == resource; });
+        if (existing != batch.barriers.end()) {
+            if (existing->barrier.newLayout != layout) {
+                throw std::runtime_error("render graph: " + resources[resource].name + " is used with two layouts in one pass!");
+            }
+            existing->barrier.dstAccessMask |= access;
+        } else {
+            batch.barriers.push_back(Barrier{resource, makeBarrier(resource, state, access, layout)});
+        }
+    }
+
+    if (hazard || write) {
+        state.layout = layout;
+        // A layout transition behaves like a write for everything that follows it.
+        state.writeStages = (write || layoutChange) ? stage : state.writeStages;
+        state.writeAccess = write ? (access & WRITE_ACCESS_MASK) : state.writeAccess;
+        state.readStages = write ? 0 : stage;
+    } else {
+        state.readStages |= stage;
+    }
+}
+
+// Hands an image from the async compute queue family to the graphics one: the release
+// ends executeAsyncCompute()'s command buffer, the acquire goes before the graphics pass.
+// The acquire waits for stage, which becomes one of the stages the graphics submission
+// waits for the async compute semaphore at, so the semaphore orders it after the release.
+void RenderGraph::transferToGraphics(BarrierBatch& release, BarrierBatch& acquire, RenderGraphResource resource, ResourceState& state, VkPipelineStageFlags stage, VkAccessFlags access, VkImageLayout layout, bool write) {
+    VkPipelineStageFlags srcStage = state.writeStages | state.readStages;
+    if (srcStage == 0) {
+        srcStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    }
+    release.srcStageMask |= srcStage;
+    release.dstStageMask |= VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+    VkImageMemoryBarrier releaseBarrier = makeBarrier(resource, state, 0, layout);
+    releaseBarrier.srcQueueFamilyIndex = asyncComputeFamily;
+    releaseBarrier.dstQueueFamilyIndex = graphicsFamily;
+    release.barriers.push_back(Barrier{resource, releaseBarrier});
+
+    VkImageMemoryBarrier acquireBarrier = releaseBarrier;
+    acquireBarrier.srcAccessMask = 0;
+    acquireBarrier.dstAccessMask = access;
+    acquire.srcStageMask |= stage;
+    acquire.dstStageMask |= stage;
+    acquire.barriers.push_back(Barrier{resource, acquireBarrier});
+    asyncComputeWaitStages |= stage;
+
+    // The acquire, like any layout transition, behaves like a write for what follows it.
+    state.layout = layout;
+    state.writeStages = stage;
+    state.writeAccess = write ? (access & WRITE_ACCESS_MASK) : 0;
+    state.readStages = write ? 0 : stage;
+    state.asyncCompute = false;
+}
+
+bool RenderGraph::runsAsync(const Pass& pass) const {
+    return pass.queue == RenderGraphQueue::AsyncCompute && asyncComputeFamily != graphicsFamily;
+}
+
+VkImageMemoryBarrier RenderGraph::makeBarrier(RenderGraphResource resource, const ResourceState& state, VkAccessFlags access, VkImageLayout layout) const {
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = state.writeAccess;
+    barrier.dstAccessMask = access;
+    barrier.oldLayout = state.layout;
+    barrier.newLayout = layout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = resources[resource].image;
+    barrier.subresourceRange.aspectMask = resources[resource].aspect;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    return barrier;
+}
+
+void RenderGraph::setImportedImage(RenderGraphResource resource, VkImage image, VkImageView view) {
+    Resource& target = resources.at(resource);
+    if (!target.imported) {
+        throw std::runtime_error("render graph: " + target.name + " is not an imported image!");
+    }
+    target.image = image;
+    target.view = view;
+}
+
+void RenderGraph::recordBatch(VkCommandBuffer commandBuffer, BarrierBatch& batch, const std::vector<Resource>& resources) {
+    if (batch.barriers.empty()) {
+        return;
+    }
+
+    for (size_t i = 0; i < batch.barriers.size(); i++) {
+        batch.recorded[i] = batch.barriers[i].barrier;
+        batch.recorded[i].image = resources[batch.barriers[i].resource].image;
+    }
+
+    vkCmdPipelineBarrier(
+        commandBuffer,
+        batch.srcStageMask, batch.dstStageMask,
+        0,
+        0, nullptr,
+        0, nullptr,
+        static_cast<uint32_t>(batch.recorded.size()), batch.recorded.data());
+}
+
+void RenderGraph::execute(VkCommandBuffer commandBuffer) {
+    if (!compiled) {
+        throw std::runtime_error("render graph: execute() called before compile()!");
+    }
+
+    for (RenderGraphPass p : executionOrder) {
+        if (runsAsync(passes[p])) {
+            continue;
+        }
+        recordBatch(commandBuffer, passes[p].before, resources);
+        passes[p].execute(commandBuffer);
+    }
+    recordBatch(commandBuffer, finalBarriers, resources);
+}
+
+bool RenderGraph::hasAsyncCompute() const {
+    return std::any_of(executionOrder.begin(), executionOrder.end(), [this](RenderGraphPass p) { return runsAsync(passes[p]); });
+}
+
+void RenderGraph::executeAsyncCompute(VkCommandBuffer commandBuffer) {
+    if (!compiled) {
+        throw std::runtime_error("render graph: executeAsyncCompute() called before compile()!");
+    }
+
+    for (RenderGraphPass p : executionOrder) {
+        if (!runsAsync(passes[p])) {
+            break; // scheduled first
+        }
+        recordBatch(commandBuffer, passes[p].before, resources);
+        passes[p].execute(commandBuffer);
+    }
+    recordBatch(commandBuffer, asyncComputeRelease, resources);
+}
+
+void RenderGraph::destroy(VkDevice device, const VkAllocationCallbacks* allocator) {
+    for (auto& resource : resources) {
+        if (resource.imported) {
+            continue;
+        }
+        if (resource.view != VK_NULL_HANDLE) {
+            vkDestroyImageView(device, resource.view, allocator);
+        }
+        if (resource.image != VK_NULL_HANDLE) {
+            vkDestroyImage(device, resource.image, allocator);
+        }
+    }
+
+    for (auto& slot : memorySlots) {
+        if (slot.memory != VK_NULL_HANDLE) {
+            vkFreeMemory(device, slot.memory, allocator);
+        }
+    }
+
+    resources.clear();
+    passes.clear();
+    executionOrder.clear();
+    memorySlots.clear();
+    finalBarriers = BarrierBatch();
+    asyncComputeRelease = BarrierBatch();
+    asyncComputeWaitStages = 0;
+    compiled = false;
+}
+
+VkImage RenderGraph::getImage(RenderGraphResource resource) const {
+    return resources.at(resource).image;
+}
+
+VkImageView RenderGraph::getImageView(RenderGraphResource resource) const {
+    return resources.at(resource).view;
+}
+
+bool RenderGraph::isCulled(RenderGraphPass pass) const {
+    return passes.at(pass).culled;
+}
+
+void RenderGraph::printSummary(std::ostream& out) const {
+    size_t barrierCount = finalBarriers.barriers.size() + asyncComputeRelease.barriers.size();
+    out << "render graph:";
+    for (RenderGraphPass p : executionOrder) {
+        out << " " << passes[p].name << (runsAsync(passes[p]) ? " (async compute)" : "");
+        barrierCount += passes[p].before.barriers.size();
+    }
+    out << "\n";
+
+    for (const auto& pass : passes) {
+        if (pass.culled) {
+            out << "  culled pass: " << pass.name << "\n";
+        }
+    }
+
+    VkDeviceSize aliasedSize = 0;
+    for (const auto& slot : memorySlots) {
+        aliasedSize += slot.size;
+    }
+    out << "  " << barrierCount << " image barriers, "
+        << memorySlots.size() << " transient allocations, "
+        << aliasedSize << " bytes\n";
+}
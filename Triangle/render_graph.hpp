@@ -0,0 +1,199 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+using RenderGraphResource = uint32_t;
+using RenderGraphPass = uint32_t;
+
+// How a pass touches an image. The graph turns these into pipeline stages, access
+// masks and layouts, so passes never write barriers by hand.
+enum class RenderGraphUsage {
+    ColorAttachment,
+    DepthStencilAttachment,
+    FragmentShaderSampled,
+    ComputeShaderSampled,
+    ComputeStorage,
+    TransferSrc,
+    TransferDst
+};
+
+// Queue a pass is recorded for. Async compute passes run ahead of the graphics passes,
+// in a command buffer of their own (executeAsyncCompute()) that is submitted to a
+// compute-only queue family; the graph derives the queue family ownership transfers of
+// the images they hand to graphics passes. Without a separate family they are recorded
+// by execute() like any other pass.
+enum class RenderGraphQueue {
+    Graphics,
+    AsyncCompute
+};
+
+// Description of an image owned by the graph. Owned images only live for one frame:
+// they start every frame with undefined contents and may share memory with other
+// owned images whose lifetimes do not overlap.
+struct RenderGraphImageDesc {
+    VkFormat format;
+    VkExtent2D extent;
+    VkSampleCountFlagBits samples;
+    VkImageUsageFlags usage;
+    VkImageAspectFlags aspect;
+    bool preferLazyMemory; // use LAZILY_ALLOCATED memory when the device has it (attachments only)
+    RenderGraphImageDesc(
+        VkFormat format = VK_FORMAT_UNDEFINED,
+        VkExtent2D extent = {},
+        VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT,
+        VkImageUsageFlags usage = 0,
+        VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT,
+        bool preferLazyMemory = false)
+        : format(format)
+        , extent(extent)
+        , samples(samples)
+        , usage(usage)
+        , aspect(aspect)
+        , preferLazyMemory(preferLazyMemory)
+    {}
+};
+
+// A per-frame graph of passes and the images they read and write. compile() orders
+// the passes, drops the ones whose results are never used, aliases the memory of
+// owned images and precomputes every layout transition and barrier; execute() then
+// only patches image handles and replays them.
+class RenderGraph {
+public:
+    using ExecuteCallback = std::function<void(VkCommandBuffer)>;
+
+    RenderGraph();
+
+    RenderGraph(const RenderGraph& source);
+    RenderGraph& operator=(const RenderGraph& source);
+
+    // An image that lives outside the graph, e.g. a swapchain image. It is bound every
+    // frame with setImportedImage() and left in finalLayout at the end of the frame.
+    // initialStage is the stage the image becomes available at (the acquire wait stage).
+    RenderGraphResource importImage(const std::string& name, VkImageAspectFlags aspect, VkImageLayout initialLayout, VkPipelineStageFlags initialStage, VkImageLayout finalLayout);
+    RenderGraphResource createImage(const std::string& name, const RenderGraphImageDesc& desc);
+
+    RenderGraphPass addPass(const std::string& name, ExecuteCallback execute, RenderGraphQueue queue = RenderGraphQueue::Graphics);
+    void read(RenderGraphPass pass, RenderGraphResource resource, RenderGraphUsage usage);
+    void write(RenderGraphPass pass, RenderGraphResource resource, RenderGraphUsage usage);
+
+    // Keeps the producers of an owned image alive even though nothing reads it.
+    void markOutput(RenderGraphResource resource);
+    // Keeps a pass alive even though it writes nothing the graph knows about (readbacks, ...).
+    void setSideEffects(RenderGraphPass pass);
+
+    // Before compile(). Async compute passes only get a queue of their own when the two
+    // families differ. They may then only use imported images (owned ones are shared by
+    // the frames in flight) and must not depend on graphics passes.
+    void setQueueFamilies(uint32_t graphicsFamily, uint32_t asyncComputeFamily);
+
+    void compile(VkDevice device, VkPhysicalDevice physicalDevice, const VkAllocationCallbacks* allocator);
+    void setImportedImage(RenderGraphResource resource, VkImage image, VkImageView view);
+    void execute(VkCommandBuffer commandBuffer);
+
+    // Whether executeAsyncCompute() records anything. Its command buffer has to signal a
+    // semaphore that the submission of execute()'s waits on at getAsyncComputeWaitStages().
+    bool hasAsyncCompute() const;
+    void executeAsyncCompute(VkCommandBuffer commandBuffer);
+    VkPipelineStageFlags getAsyncComputeWaitStages() const { return asyncComputeWaitStages; }
+
+    // Destroys the owned images and forgets every pass and resource so the graph can be rebuilt.
+    void destroy(VkDevice device, const VkAllocationCallbacks* allocator);
+
+    VkImage getImage(RenderGraphResource resource) const;
+    VkImageView getImageView(RenderGraphResource resource) const;
+    bool isCulled(RenderGraphPass pass) const;
+    void printSummary(std::ostream& out) const;
+
+private:
+    struct Access {
+        RenderGraphResource resource;
+        RenderGraphUsage usage;
+        bool write;
+    };
+
+    struct Resource {
+        std::string name;
+        bool imported;
+        RenderGraphImageDesc desc;
+        VkImageAspectFlags aspect;
+        VkImageLayout initialLayout;
+        VkPipelineStageFlags initialStage;
+        VkImageLayout finalLayout;
+        bool output;
+        VkImage image;
+        VkImageView view;
+        uint32_t memorySlot;
+        uint32_t firstUse; // positions in executionOrder
+        uint32_t lastUse;
+    };
+
+    struct Barrier {
+        RenderGraphResource resource;
+        VkImageMemoryBarrier barrier;
+    };
+
+    struct BarrierBatch {
+        VkPipelineStageFlags srcStageMask = 0;
+        VkPipelineStageFlags dstStageMask = 0;
+        std::vector<Barrier> barriers = {};
+        std::vector<VkImageMemoryBarrier> recorded = {}; // what execute() hands to vkCmdPipelineBarrier
+    };
+
+    struct Pass {
+        std::string name;
+        ExecuteCallback execute;
+        RenderGraphQueue queue;
+        std::vector<Access> accesses;
+        bool sideEffects;
+        bool culled;
+        BarrierBatch before;
+    };
+
+    // Where a resource was last touched, used to derive the next barrier.
+    struct ResourceState {
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags writeStages = 0;
+        VkAccessFlags writeAccess = 0;
+        VkPipelineStageFlags readStages = 0;
+        bool asyncCompute = false; // owned by the async compute queue family
+    };
+
+    struct MemorySlot {
+        VkDeviceMemory memory;
+        VkDeviceSize size;
+        uint32_t memoryTypeBits;
+        bool lazy;
+        std::vector<RenderGraphResource> occupants; // in order of first use
+    };
+
+    std::vector<Resource> resources;
+    std::vector<Pass> passes;
+    std::vector<RenderGraphPass> executionOrder;
+    std::vector<MemorySlot> memorySlots;
+    BarrierBatch finalBarriers;
+    uint32_t graphicsFamily;
+    uint32_t asyncComputeFamily;
+    BarrierBatch asyncComputeRelease; // ends executeAsyncCompute()
+    VkPipelineStageFlags asyncComputeWaitStages;
+    bool compiled;
+
+    void addAccess(RenderGraphPass pass, RenderGraphResource resource, RenderGraphUsage usage, bool write);
+    void sortPasses();
+    void scheduleAsyncCompute();
+    void cullPasses();
+    void computeLifetimes();
+    void allocateOwnedImages(VkDevice device, VkPhysicalDevice physicalDevice, const VkAllocationCallbacks* allocator);
+    void buildBarriers();
+    std::vector<ResourceState> simulate(const std::vector<ResourceState>& initialStates, bool record);
+    void transition(BarrierBatch& batch, RenderGraphResource resource, ResourceState& state, VkPipelineStageFlags stage, VkAccessFlags access, VkImageLayout layout, bool write);
+    void transferToGraphics(BarrierBatch& release, BarrierBatch& acquire, RenderGraphResource resource, ResourceState& state, VkPipelineStageFlags stage, VkAccessFlags access, VkImageLayout layout, bool write);
+    bool runsAsync(const Pass& pass) const;
+    VkImageMemoryBarrier makeBarrier(RenderGraphResource resource, const ResourceState& state, VkAccessFlags access, VkImageLayout layout) const;
+    static void recordBatch(VkCommandBuffer commandBuffer, BarrierBatch& batch, const std::vector<Resource>& resources);
+};
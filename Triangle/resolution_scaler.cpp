@@ -0,0 +1,112 @@
+#include "resolution_scaler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+
+// Aim a little below the budget so noise does not push every other frame over it.
+const double BUDGET_HEADROOM = 0.9;
+// Ignore errors smaller than this fraction of the target; stops the scale from dithering.
+const double DEADBAND = 0.05;
+// Weight of the newest sample in the smoothed GPU time.
+const double SMOOTHING = 0.2;
+// Fraction of the way to the ideal scale taken per frame. Going down is urgent (frames
+// are being missed), going up is not and doing it slowly avoids oscillation, since the
+// effect of a change only shows up frames in flight later.
+const double GAIN_DOWN = 0.5;
+const double GAIN_UP = 0.05;
+// Scaled extents are rounded to multiples of this many pixels.
+const uint32_t EXTENT_GRANULARITY = 8;
+
+} // namespace
+
+ResolutionScaler::ResolutionScaler()
+    : gpuBudgetMs(0.0)
+    , minScale(1.0)
+    , maxScale(1.0)
+    , scale(1.0)
+    , smoothedGpuMs(0.0)
+    , history(HISTORY_SIZE)
+    , historyNext(0)
+    , sampleCount(0)
+    , scaleSum(0.0)
+    , minScaleSeen(1.0)
+{}
+
+void ResolutionScaler::configure(double gpuBudgetMs, double minScale, double maxScale) {
+    if (minScale <= 0.0 || maxScale > 1.0 || minScale > maxScale) {
+        throw std::runtime_error("render scale must be in (0, 1]!");
+    }
+
+    this->gpuBudgetMs = gpuBudgetMs;
+    this->minScale = minScale;
+    this->maxScale = maxScale;
+    scale = maxScale;
+    minScaleSeen = maxScale;
+}
+
+void ResolutionScaler::update(uint64_t frame, double gpuMs) {
+    if (isAdaptive()) {
+        smoothedGpuMs = sampleCount == 0 ? gpuMs : smoothedGpuMs + SMOOTHING * (gpuMs - smoothedGpuMs);
+
+        double target = gpuBudgetMs * BUDGET_HEADROOM;
+        double error = (smoothedGpuMs - target) / target;
+        if (std::abs(error) > DEADBAND && smoothedGpuMs > 0.0) {
+            double ideal = scale * std::sqrt(target / smoothedGpuMs);
+            double gain = ideal < scale ? GAIN_DOWN : GAIN_UP;
+            scale = std::clamp(scale + gain * (ideal - scale), minScale, maxScale);
+        }
+    }
+
+    history[historyNext] = ResolutionSample(frame, static_cast<float>(gpuMs), static_cast<float>(scale));
+    historyNext = (historyNext + 1) % HISTORY_SIZE;
+    sampleCount++;
+    scaleSum += scale;
+    minScaleSeen = std::min(minScaleSeen, scale);
+}
+
+VkExtent2D ResolutionScaler::scaledExtent(VkExtent2D outputExtent) const {
+    auto scaleAxis = [this](uint32_t size) {
+        uint32_t scaled = static_cast<uint32_t>(std::lround(size * scale / EXTENT_GRANULARITY)) * EXTENT_GRANULARITY;
+        return std::clamp<uint32_t>(scaled, std::min(size, EXTENT_GRANULARITY), size);
+    };
+    return {scaleAxis(outputExtent.width), scaleAxis(outputExtent.height)};
+}
+
+std::vector<ResolutionSample> ResolutionScaler::getHistory() const {
+    std::vector<ResolutionSample> samples;
+    size_t count = static_cast<size_t>(std::min<uint64_t>(sampleCount, HISTORY_SIZE));
+    samples.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        samples.push_back(history[(historyNext + HISTORY_SIZE - count + i) % HISTORY_SIZE]);
+    }
+    return samples;
+}
+
+void ResolutionScaler::writeHistory(const std::string& filename) const {
+    std::ofstream file(filename);
+    if (!file.is_open()) {
+        throw std::runtime_error("failed to open " + filename + " for writing!");
+    }
+
+    file << "frame,gpu_ms,scale\n";
+    for (const auto& sample : getHistory()) {
+        file << sample.frame << "," << sample.gpuMs << "," << sample.scale << "\n";
+    }
+}
+
+void ResolutionScaler::printSummary(std::ostream& out) const {
+    if (sampleCount == 0) {
+        return;
+    }
+
+    out << "dynamic resolution: ";
+    if (isAdaptive()) {
+        out << gpuBudgetMs << " ms GPU budget, ";
+    }
+    out << "scale " << scaleSum / static_cast<double>(sampleCount) << " avg, "
+        << minScaleSeen << " min, " << scale << " last\n";
+}
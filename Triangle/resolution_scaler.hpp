@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct ResolutionSample {
+    uint64_t frame;
+    float gpuMs;
+    float scale; // scale chosen after this sample
+    ResolutionSample(uint64_t frame = 0, float gpuMs = 0.0f, float scale = 1.0f)
+        : frame(frame)
+        , gpuMs(gpuMs)
+        , scale(scale)
+    {}
+};
+
+// Feedback controller for dynamic resolution. Fed the GPU time of every finished frame,
+// it picks the fraction of the output resolution (per axis) to render at so that GPU
+// time settles just under the budget. GPU time is assumed to grow with the pixel count,
+// i.e. with the square of the scale.
+class ResolutionScaler {
+public:
+    ResolutionScaler();
+
+    // A budget of 0 disables the controller and keeps the scale at maxScale.
+    void configure(double gpuBudgetMs, double minScale, double maxScale);
+    bool isAdaptive() const { return gpuBudgetMs > 0.0; }
+
+    void update(uint64_t frame, double gpuMs);
+
+    double getScale() const { return scale; }
+    // The extent to render at for an output of the given size.
+    VkExtent2D scaledExtent(VkExtent2D outputExtent) const;
+
+    // The last HISTORY_SIZE samples, oldest first.
+    std::vector<ResolutionSample> getHistory() const;
+    void writeHistory(const std::string& filename) const;
+    void printSummary(std::ostream& out) const;
+
+private:
+    static constexpr size_t HISTORY_SIZE = 1024;
+
+    double gpuBudgetMs;
+    double minScale;
+    double maxScale;
+    double scale;
+    double smoothedGpuMs;
+
+    std::vector<ResolutionSample> history; // ring of HISTORY_SIZE samples
+    size_t historyNext;
+    uint64_t sampleCount;
+    double scaleSum;
+    double minScaleSeen;
+};
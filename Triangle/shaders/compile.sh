@@ -1,2 +1,6 @@
 /usr/bin/glslc shader.vert -o vert.spv
 /usr/bin/glslc shader.frag -o frag.spv
+/usr/bin/glslc overlay.comp -o overlay.comp.spv
+/usr/bin/spirv-val --target-env vulkan1.0 vert.spv
+/usr/bin/spirv-val --target-env vulkan1.0 frag.spv
+/usr/bin/spirv-val --target-env vulkan1.0 overlay.comp.spv
@@ -0,0 +1,373 @@
+// Golden image and frame time regression tests. Renders every scene headlessly (meant
+// for lavapipe, see `make check`), compares the captured frame against
+// tests/golden/<scene>.png and the median frame time against tests/frame_times.baseline.
+// --app defaults to the release build with the allocation audit (`make release-audit`):
+// the debug build's validation layers would dominate the frame times, while the audit
+// costs nothing until a steady-state frame allocates, which then fails the scene.
+//
+//   golden_test [--app PATH] [--update-golden] [--update-baseline] [scene...]
+
+#include "image_io.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <bit>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+const char* GOLDEN_DIRECTORY = "tests/golden";
+const char* OUTPUT_DIRECTORY = "tests/out";
+const char* BASELINE_FILE = "tests/frame_times.baseline";
+const char* TEXTURE_DIRECTORY = "tests/out/textures"; // written by writeTestTextures()
+
+// Frames rendered per scene; the last one is compared. Enough frames to cycle through
+// every swapchain image and frame in flight, and to give the median a few samples.
+const uint64_t FRAME_COUNT = 64;
+
+// Per-pixel YIQ color distance above which a pixel counts as different (0..1, same scale
+// as pixelmatch), and the share of different pixels a scene may have. Rasterization and
+// resolve rules leave drivers a little freedom along triangle edges.
+const double PIXEL_THRESHOLD = 0.1;
+const double MAX_DIFFERENT_PIXELS = 0.001;
+
+// A scene fails when its median frame time exceeds the baseline by this factor plus
+// an absolute slack that absorbs timer noise on very fast frames.
+const double FRAME_TIME_TOLERANCE = 1.25;
+const double FRAME_TIME_SLACK_MS = 0.25;
+
+// Streamed textures: together more than the budget the scene gives them, so the streamer
+// has to stop loading early and keep the coarse levels only.
+const uint32_t TEST_TEXTURE_COUNT = 3;
+const uint32_t TEST_TEXTURE_SIZE = 512;
+const uint32_t TEST_TEXTURE_BUDGET_MIB = 2;
+const uint32_t FORMAT_R8G8B8A8_UNORM = 37; // VkFormat, this file does not include Vulkan
+
+struct Scene {
+    std::string name;
+    std::string arguments;
+    Scene(std::string name = "", std::string arguments = "")
+        : name(name)
+        , arguments(arguments)
+    {}
+};
+
+const std::vector<Scene> scenes = {
+    Scene("triangle", ""),
+    Scene("triangle_msaa4", "--msaa 4"),
+    Scene("triangle_render_pass", "--render-pass"),
+    Scene("triangle_render_pass_msaa4", "--render-pass --msaa 4"),
+    Scene("triangle_scale50", "--render-scale 0.5"),
+    Scene("triangle_two_windows", "--windows 2"),
+    Scene("triangle_sync_validation", "--validation sync"),
+    // Nothing samples the textures, so checkTextureStreaming() checks the residency instead.
+    Scene("triangle_texture_streaming", std::string("--textures ") + TEXTURE_DIRECTORY + " --texture-budget " + std::to_string(TEST_TEXTURE_BUDGET_MIB)),
+    // Synchronization validation checks the overlay's compute pass against the blit. Lavapipe
+    // has a single queue family, so there the pass runs inline on the graphics queue: the
+    // queue family ownership transfer (release on the compute queue, acquire on graphics)
+    // only runs, and is only validated, on devices with a compute-only family.
+    Scene("triangle_compute_overlay", "--compute-overlay --validation sync")
+};
+
+struct Options {
+    std::string app;
+    bool updateGolden;
+    bool updateBaseline;
+    std::vector<std::string> sceneFilter;
+    Options(std::string app = "build/release-audit/noob", bool updateGolden = false, bool updateBaseline = false, std::vector<std::string> sceneFilter = {})
+        : app(app)
+        , updateGolden(updateGolden)
+        , updateBaseline(updateBaseline)
+        , sceneFilter(sceneFilter)
+    {}
+};
+
+double yiq(const uint8_t* a, const uint8_t* b) {
+    double r = a[0] - b[0], g = a[1] - b[1], bl = a[2] - b[2];
+    double y = r * 0.29889531 + g * 0.58662247 + bl * 0.11448223;
+    double i = r * 0.59597799 - g * 0.27417610 - bl * 0.32180189;
+    double q = r * 0.21147017 - g * 0.52261711 + bl * 0.31114694;
+    return 0.5053 * y * y + 0.299 * i * i + 0.1957 * q * q;
+}
+
+// Returns the share of pixels that differ perceptually and writes a diff image with
+// the differing pixels in red over a faded grey copy of the expected image.
+double compareImages(const Image& expected, const Image& actual, const std::string& diffFile) {
+    const double maxDelta = 35215.0; // yiq() of black against white
+    const double threshold = PIXEL_THRESHOLD * PIXEL_THRESHOLD * maxDelta;
+
+    std::vector<uint8_t> diff(expected.pixels.size());
+    size_t different = 0;
+    for (size_t i = 0; i < expected.pixels.size(); i += 4) {
+        bool differs = yiq(&expected.pixels[i], &actual.pixels[i]) > threshold;
+        different += differs ? 1 : 0;
+
+        // Luminance (Rec. 601 weights, as in yiq()) faded toward white.
+        const uint8_t* pixel = &expected.pixels[i];
+        double luminance = pixel[0] * 0.29889531 + pixel[1] * 0.58662247 + pixel[2] * 0.11448223;
+        uint8_t faded = static_cast<uint8_t>(255.0 - (255.0 - luminance) / 4.0);
+        diff[i + 0] = differs ? 255 : faded;
+        diff[i + 1] = differs ? 0 : faded;
+        diff[i + 2] = differs ? 0 : faded;
+        diff[i + 3] = 255;
+    }
+
+    if (different > 0) {
+        writePng(diffFile, expected.width, expected.height, diff.data());
+    }
+    return static_cast<double>(different) / static_cast<double>(expected.pixels.size() / 4);
+}
+
+std::map<std::string, double> readKeyValues(const std::string& filename) {
+    std::map<std::string, double> values;
+    std::ifstream file(filename);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        size_t space = line.find(' ');
+        if (space != std::string::npos) {
+            values[line.substr(0, space)] = std::stod(line.substr(space + 1));
+        }
+    }
+    return values;
+}
+
+void writeBaseline(const std::map<std::string, double>& baseline) {
+    std::ofstream file(BASELINE_FILE);
+    if (!file.is_open()) {
+        throw std::runtime_error(std::string("failed to open ") + BASELINE_FILE + " for writing!");
+    }
+    file << "# median drawFrame() time in ms per scene, regenerate with `make baseline`\n";
+    for (const auto& [scene, medianMs] : baseline) {
+        file << scene << " " << medianMs << "\n";
+    }
+}
+
+// Uncompressed RGBA8 KTX2 files with a full mip chain and a different checkerboard in
+// every level, so a level copied to the wrong place would show once something samples them.
+void writeTestTextures() {
+    std::filesystem::create_directories(TEXTURE_DIRECTORY);
+    const uint32_t levelCount = std::bit_width(TEST_TEXTURE_SIZE);
+    const size_t headerSize = 80;
+    const size_t levelIndexEntrySize = 24;
+
+    for (uint32_t texture = 0; texture < TEST_TEXTURE_COUNT; texture++) {
+        std::vector<uint8_t> file(headerSize + levelCount * levelIndexEntrySize);
+        auto put32 = [&file](size_t offset, uint32_t value) { std::memcpy(&file[offset], &value, sizeof(value)); };
+        auto put64 = [&file](size_t offset, uint64_t value) { std::memcpy(&file[offset], &value, sizeof(value)); };
+
+        const uint8_t identifier[12] = {0xab, 'K', 'T', 'X', ' ', '2', '0', 0xbb, '\r', '\n', 0x1a, '\n'};
+        std::memcpy(file.data(), identifier, sizeof(identifier));
+        put32(12, FORMAT_R8G8B8A8_UNORM);
+        put32(16, 1); // typeSize
+        put32(20, TEST_TEXTURE_SIZE);
+        put32(24, TEST_TEXTURE_SIZE);
+        put32(36, 1); // faceCount
+        put32(40, levelCount);
+
+        for (uint32_t level = 0; level < levelCount; level++) {
+            uint32_t size = TEST_TEXTURE_SIZE >> level;
+            size_t offset = file.size();
+            size_t levelSize = static_cast<size_t>(size) * size * 4;
+            put64(headerSize + level * levelIndexEntrySize, offset);
+            put64(headerSize + level * levelIndexEntrySize + 8, levelSize);
+            put64(headerSize + level * levelIndexEntrySize + 16, levelSize);
+
+            file.resize(offset + levelSize);
+            uint8_t shade = static_cast<uint8_t>(255 - level * 20);
+            for (uint32_t y = 0; y < size; y++) {
+                for (uint32_t x = 0; x < size; x++) {
+                    uint8_t* pixel = &file[offset + (static_cast<size_t>(y) * size + x) * 4];
+                    bool odd = ((x / 8) + (y / 8) + texture) % 2 == 1;
+                    pixel[0] = odd ? shade : 0;
+                    pixel[1] = static_cast<uint8_t>(texture * 80);
+                    pixel[2] = odd ? 0 : shade;
+                    pixel[3] = 255;
+                }
+            }
+        }
+
+        std::filesystem::path path = std::filesystem::path(TEXTURE_DIRECTORY) / ("texture" + std::to_string(texture) + ".ktx2");
+        std::ofstream out(path, std::ios::binary);
+        out.write(reinterpret_cast<const char*>(file.data()), static_cast<std::streamsize>(file.size()));
+        if (!out) {
+            throw std::runtime_error("failed to write " + path.string() + "!");
+        }
+    }
+}
+
+// Streamed textures leave no trace in the image, so their scene is checked through the
+// residency the app writes to its --stats file: every texture has levels resident, the
+// textures fit into the budget, and the budget kept at least one from loading completely.
+// Returns what is wrong, or an empty string.
+std::string checkTextureStreaming(std::map<std::string, double>& stats) {
+    if (stats["texture_count"] != TEST_TEXTURE_COUNT) {
+        return "streamed " + std::to_string(static_cast<int>(stats["texture_count"])) + " of " + std::to_string(TEST_TEXTURE_COUNT) + " textures";
+    }
+    if (stats["texture_memory_limit"] != TEST_TEXTURE_BUDGET_MIB * 1024.0 * 1024.0) {
+        return "texture budget is not " + std::to_string(TEST_TEXTURE_BUDGET_MIB) + " MiB";
+    }
+    if (stats["texture_bytes"] > stats["texture_memory_limit"]) {
+        return "textures use " + std::to_string(static_cast<uint64_t>(stats["texture_bytes"])) + " bytes, over the budget";
+    }
+
+    bool allComplete = true;
+    for (uint32_t i = 0; i < TEST_TEXTURE_COUNT; i++) {
+        std::string texture = "texture" + std::to_string(i);
+        double residentLevel = stats[texture + "_resident_level"];
+        if (residentLevel >= stats[texture + "_level_count"]) {
+            return texture + " has no resident levels";
+        }
+        allComplete = allComplete && residentLevel == 0;
+    }
+    if (allComplete) {
+        return "every texture is fully resident, the budget limited nothing";
+    }
+    return "";
+}
+
+// Renders one scene and checks it. Returns false on any failure.
+bool runScene(const Scene& scene, const Options& options, std::map<std::string, double>& baseline) {
+    std::filesystem::path outDirectory = std::filesystem::path(OUTPUT_DIRECTORY) / scene.name;
+    std::filesystem::remove_all(outDirectory);
+    std::filesystem::create_directories(outDirectory);
+    std::filesystem::path statsFile = outDirectory / "stats.txt";
+
+    std::string command = options.app + " --headless"
+        + " --frames " + std::to_string(FRAME_COUNT)
+        + " --capture " + outDirectory.string()
+        + " --capture-frame " + std::to_string(FRAME_COUNT - 1)
+        + " --stats " + statsFile.string()
+        + " " + scene.arguments;
+    if (std::system(command.c_str()) != 0) {
+        std::cout << "[FAIL] " << scene.name << ": `" << command << "` failed\n";
+        return false;
+    }
+
+    char frameName[32];
+    std::snprintf(frameName, sizeof(frameName), "frame_%06llu.png", static_cast<unsigned long long>(FRAME_COUNT - 1));
+    Image actual = readPng((outDirectory / frameName).string());
+    std::filesystem::path goldenFile = std::filesystem::path(GOLDEN_DIRECTORY) / (scene.name + ".png");
+
+    std::map<std::string, double> stats = readKeyValues(statsFile.string());
+    double medianMs = stats["median_ms"];
+
+    if (options.updateGolden) {
+        std::filesystem::create_directories(GOLDEN_DIRECTORY);
+        writePng(goldenFile.string(), actual.width, actual.height, actual.pixels.data());
+        std::cout << "[ UPD] " << scene.name << ": " << goldenFile.string() << "\n";
+    }
+    if (options.updateBaseline) {
+        baseline[scene.name] = medianMs;
+        std::cout << "[ UPD] " << scene.name << ": baseline " << medianMs << " ms\n";
+    }
+    if (options.updateGolden || options.updateBaseline) {
+        return true;
+    }
+
+    if (!std::filesystem::exists(goldenFile)) {
+        std::cout << "[FAIL] " << scene.name << ": no golden image, create it with `make golden`\n";
+        return false;
+    }
+
+    Image expected = readPng(goldenFile.string());
+    if (expected.width != actual.width || expected.height != actual.height) {
+        std::cout << "[FAIL] " << scene.name << ": rendered " << actual.width << "x" << actual.height
+                  << ", golden image is " << expected.width << "x" << expected.height << "\n";
+        return false;
+    }
+
+    std::string diffFile = (outDirectory / "diff.png").string();
+    double different = compareImages(expected, actual, diffFile);
+    bool imagePassed = different <= MAX_DIFFERENT_PIXELS;
+
+    // A scene without a baseline fails like one without a golden image: otherwise a new
+    // scene, or a lost baseline file, would quietly turn the frame time gate off.
+    auto budget = baseline.find(scene.name);
+    double budgetMs = budget != baseline.end() ? budget->second * FRAME_TIME_TOLERANCE + FRAME_TIME_SLACK_MS : 0.0;
+    bool timePassed = budget != baseline.end() && medianMs <= budgetMs;
+
+    std::string streamingError = stats.count("texture_count") != 0 ? checkTextureStreaming(stats) : "";
+
+    std::cout << (imagePassed && timePassed && streamingError.empty() ? "[  OK] " : "[FAIL] ") << scene.name << ": " << different * 100.0 << "% pixels differ";
+    if (!imagePassed) {
+        std::cout << " (see " << diffFile << ")";
+    }
+    std::cout << ", median " << medianMs << " ms";
+    if (budget == baseline.end()) {
+        std::cout << ", no baseline, create it with `make baseline`\n";
+    } else if (timePassed) {
+        std::cout << " of " << budgetMs << " ms budget\n";
+    } else {
+        std::cout << " over " << budgetMs << " ms budget (baseline " << budget->second << " ms)\n";
+    }
+    if (!streamingError.empty()) {
+        std::cout << "       texture streaming: " << streamingError << "\n";
+    }
+
+    return imagePassed && timePassed && streamingError.empty();
+}
+
+Options parseOptions(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--app" && i + 1 < argc) {
+            options.app = argv[++i];
+        } else if (arg == "--update-golden") {
+            options.updateGolden = true;
+        } else if (arg == "--update-baseline") {
+            options.updateBaseline = true;
+        } else if (arg.starts_with("--")) {
+            throw std::runtime_error("unknown option: " + arg);
+        } else {
+            options.sceneFilter.push_back(arg);
+        }
+    }
+    return options;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    try {
+        Options options = parseOptions(argc, argv);
+        std::map<std::string, double> baseline = readKeyValues(BASELINE_FILE);
+        writeTestTextures();
+
+        int failures = 0;
+        for (const auto& scene : scenes) {
+            bool selected = options.sceneFilter.empty();
+            for (const auto& name : options.sceneFilter) {
+                selected = selected || name == scene.name;
+            }
+            if (selected && !runScene(scene, options, baseline)) {
+                failures++;
+            }
+        }
+
+        if (options.updateBaseline) {
+            writeBaseline(baseline);
+        }
+
+        if (failures > 0) {
+            std::cout << failures << " scene(s) failed\n";
+            return EXIT_FAILURE;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
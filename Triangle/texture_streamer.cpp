@@ -0,0 +1,779 @@
+#include "texture_streamer.hpp"
+#include "vulkan_memory.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+const uint32_t MAX_LEVELS = 32;
+
+VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+VkDeviceSize fraction(VkDeviceSize bytes, double fraction) {
+    return static_cast<VkDeviceSize>(static_cast<double>(bytes) * fraction);
+}
+
+double toMiB(uint64_t bytes) {
+    return static_cast<double>(bytes) / (1024.0 * 1024.0);
+}
+
+} // namespace
+
+TextureStreamer::TextureStreamer()
+    : device(VK_NULL_HANDLE)
+    , physicalDevice(VK_NULL_HANDLE)
+    , allocator(nullptr)
+    , graphicsFamily(0)
+    , transferFamily(0)
+    , transferQueue(VK_NULL_HANDLE)
+    , transferCommandPool(VK_NULL_HANDLE)
+    , useMemoryBudget(false)
+    , memoryLimit(0)
+    , heapIndex(0)
+    , heapSize(0)
+    , sampler(VK_NULL_HANDLE)
+    , stagingBuffer(VK_NULL_HANDLE)
+    , stagingMemory(VK_NULL_HANDLE)
+    , stagingMapped(nullptr)
+    , stagingSize(0)
+    , textures()
+    , frames()
+    , textureBytes(0)
+    , retiringBytes(0)
+    , evictionPending(false)
+    , mutex()
+    , loaderWakeup()
+    , stagingHead(0)
+    , stagingTail(0)
+    , staged()
+    , stagedHead(0)
+    , stagedCount(0)
+    , loadHeadroom(0)
+    , stagedBytes(0)
+    , stopping(false)
+    , loaderError()
+    , uploadCount(0)
+    , uploadedBytes(0)
+    , evictionCount(0)
+    , peakTextureBytes(0)
+    , stagingHighWater(0)
+    , loader()
+{}
+
+TextureStreamer::~TextureStreamer() {
+    stopLoader();
+}
+
+void TextureStreamer::create(VkDevice device, VkPhysicalDevice physicalDevice, const VkAllocationCallbacks* allocator, uint32_t framesInFlight,
+    uint32_t graphicsFamily, uint32_t transferFamily, VkQueue transferQueue,
+    bool useMemoryBudget, VkDeviceSize memoryLimit, VkDeviceSize stagingSize) {
+    this->device = device;
+    this->physicalDevice = physicalDevice;
+    this->allocator = allocator;
+    this->graphicsFamily = graphicsFamily;
+    this->transferFamily = transferFamily;
+    this->transferQueue = transferQueue;
+    this->useMemoryBudget = useMemoryBudget;
+    this->memoryLimit = memoryLimit;
+    this->stagingSize = stagingSize / STAGING_ALIGNMENT * STAGING_ALIGNMENT;
+    frames.assign(framesInFlight, FrameChanges{});
+
+    std::optional<uint32_t> deviceLocalType = findMemoryType(physicalDevice, ~0u, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    if (!deviceLocalType.has_value()) {
+        throw std::runtime_error("failed to find device local memory for textures!");
+    }
+    VkPhysicalDeviceMemoryProperties memProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+    heapIndex = memProperties.memoryTypes[deviceLocalType.value()].heapIndex;
+    heapSize = memProperties.memoryHeaps[heapIndex].size;
+
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.minLod = 0.0f;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+    if (vkCreateSampler(device, &samplerInfo, allocator, &sampler) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create texture sampler!");
+    }
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = this->stagingSize;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateBuffer(device, &bufferInfo, allocator, &stagingBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create texture staging buffer!");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(device, stagingBuffer, &memRequirements);
+
+    // Only ever written by the CPU, sequentially: write combined memory is fine.
+    std::optional<uint32_t> memoryType = findMemoryType(physicalDevice, memRequirements.memoryTypeBits,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    if (!memoryType.has_value()) {
+        throw std::runtime_error("failed to find host visible memory for texture staging!");
+    }
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = memoryType.value();
+
+    if (vkAllocateMemory(device, &allocInfo, allocator, &stagingMemory) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate texture staging memory!");
+    }
+    vkBindBufferMemory(device, stagingBuffer, stagingMemory, 0);
+
+    void* mapped = nullptr;
+    if (vkMapMemory(device, stagingMemory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS) {
+        throw std::runtime_error("failed to map texture staging memory!");
+    }
+    stagingMapped = static_cast<std::byte*>(mapped);
+
+    if (transferFamily == graphicsFamily) {
+        return;
+    }
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    poolInfo.queueFamilyIndex = transferFamily;
+
+    if (vkCreateCommandPool(device, &poolInfo, allocator, &transferCommandPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create texture transfer command pool!");
+    }
+
+    VkCommandBufferAllocateInfo commandBufferInfo{};
+    commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    commandBufferInfo.commandPool = transferCommandPool;
+    commandBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    commandBufferInfo.commandBufferCount = 1;
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    for (FrameChanges& frame : frames) {
+        if (vkAllocateCommandBuffers(device, &commandBufferInfo, &frame.transferCommandBuffer) != VK_SUCCESS ||
+            vkCreateSemaphore(device, &semaphoreInfo, allocator, &frame.transferFinished) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create texture transfer objects for a frame!");
+        }
+    }
+}
+
+void TextureStreamer::destroy() {
+    stopLoader();
+    if (device == VK_NULL_HANDLE) {
+        return;
+    }
+
+    // Prepared by the loader, but never recorded.
+    for (uint32_t i = 0; i < stagedCount; i++) {
+        destroyImage(staged[(stagedHead + i) % MAX_STAGED_UPLOADS]);
+    }
+    stagedCount = 0;
+
+    // The device is idle, so every recorded change has completed.
+    for (uint32_t frame = 0; frame < frames.size(); frame++) {
+        frameCompleted(frame);
+    }
+    for (const auto& texture : textures) {
+        if (texture->image != VK_NULL_HANDLE) {
+            vkDestroyImageView(device, texture->view, allocator);
+            vkDestroyImage(device, texture->image, allocator);
+            vkFreeMemory(device, texture->memory, allocator);
+        }
+    }
+    textures.clear();
+
+    for (FrameChanges& frame : frames) {
+        vkDestroySemaphore(device, frame.transferFinished, allocator);
+    }
+    vkDestroyCommandPool(device, transferCommandPool, allocator);
+    transferCommandPool = VK_NULL_HANDLE;
+
+    vkUnmapMemory(device, stagingMemory);
+    vkDestroyBuffer(device, stagingBuffer, allocator);
+    vkFreeMemory(device, stagingMemory, allocator);
+    vkDestroySampler(device, sampler, allocator);
+    device = VK_NULL_HANDLE;
+}
+
+uint32_t TextureStreamer::addTexture(const std::string& filename) {
+    auto texture = std::make_unique<Texture>();
+    texture->file.open(filename);
+    const Ktx2File& file = texture->file;
+
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, file.getFormat(), &formatProperties);
+    if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) {
+        throw std::runtime_error("failed to load " + filename + ": the device cannot sample its format!");
+    }
+
+    uint32_t levelCount = file.getLevelCount();
+    texture->residentLevel = levelCount;
+    texture->loadedLevel = levelCount;
+
+    // The first upload is the mip tail, every later one a single level; each has to fit
+    // into the staging ring at once.
+    uint32_t tailLevel = nextFirstLevel(*texture);
+    if (stagedSize(*texture, tailLevel, levelCount) > stagingSize) {
+        throw std::runtime_error("failed to load " + filename + ": even its smallest levels do not fit into the staging buffer!");
+    }
+    texture->finestLoadableLevel = tailLevel;
+    while (texture->finestLoadableLevel > 0 && stagedSize(*texture, texture->finestLoadableLevel - 1, texture->finestLoadableLevel) <= stagingSize) {
+        texture->finestLoadableLevel--;
+    }
+    if (texture->finestLoadableLevel > 0) {
+        std::cerr << filename << ": levels finer than " << texture->finestLoadableLevel << " do not fit into the staging buffer and are skipped\n";
+    }
+
+    textures.push_back(std::move(texture));
+    return static_cast<uint32_t>(textures.size() - 1);
+}
+
+void TextureStreamer::start() {
+    stopping = false;
+    loader = std::thread(&TextureStreamer::loaderLoop, this);
+}
+
+void TextureStreamer::stopLoader() {
+    if (!loader.joinable()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    loaderWakeup.notify_all();
+    loader.join();
+}
+
+void TextureStreamer::recordUploads(VkCommandBuffer commandBuffer, uint32_t frameInFlight) {
+    FrameChanges& frame = frames[frameInFlight];
+    frame.transferSubmitted = false;
+    bool transferRecording = false;
+
+    // One eviction at a time: the memory only counts as freed once it is recorded.
+    if (updateBudget() && !evictionPending) {
+        evictionPending = requestEviction();
+    }
+
+    uint32_t changes = 0;
+    VkDeviceSize frameBytes = 0;
+    while (changes < MAX_CHANGES_PER_FRAME) {
+        StagedUpload upload{};
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (loaderError) {
+                std::rethrow_exception(loaderError);
+            }
+            if (stagedCount == 0) {
+                break;
+            }
+            upload = staged[stagedHead];
+            VkDeviceSize size = upload.stagingEnd - upload.stagingStart;
+            if (changes > 0 && frameBytes + size > MAX_UPLOAD_BYTES_PER_FRAME) {
+                break; // next frame
+            }
+            stagedHead = (stagedHead + 1) % MAX_STAGED_UPLOADS;
+            stagedCount--;
+            stagedBytes -= size;
+            frameBytes += size;
+        }
+        loaderWakeup.notify_all(); // a staged upload slot is free again
+
+        // Evictions stage nothing, they only copy on the graphics queue.
+        bool transferred = transferCommandPool != VK_NULL_HANDLE && upload.endLevel > upload.firstLevel;
+        if (transferred && !transferRecording) {
+            VkCommandBufferBeginInfo beginInfo{};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            if (vkBeginCommandBuffer(frame.transferCommandBuffer, &beginInfo) != VK_SUCCESS) {
+                throw std::runtime_error("failed to begin recording texture transfer command buffer!");
+            }
+            transferRecording = true;
+        }
+        if (transferred) {
+            recordTransfer(frame.transferCommandBuffer, upload);
+        }
+        replaceImage(commandBuffer, upload, transferred, frame);
+        if (upload.firstLevel == upload.endLevel) {
+            evictionPending = false;
+            evictionCount++;
+        } else {
+            frame.stagingEnd = upload.stagingEnd;
+            uploadCount++;
+            uploadedBytes += upload.stagingEnd - upload.stagingStart;
+        }
+        changes++;
+    }
+
+    if (!transferRecording) {
+        return;
+    }
+    if (vkEndCommandBuffer(frame.transferCommandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to record texture transfer command buffer!");
+    }
+
+    // No fence: the frame's graphics submission waits on transferFinished, so its fence
+    // covers this submission too.
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &frame.transferCommandBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &frame.transferFinished;
+
+    if (vkQueueSubmit(transferQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit texture transfer command buffer!");
+    }
+    frame.transferSubmitted = true;
+}
+
+void TextureStreamer::frameCompleted(uint32_t frameInFlight) {
+    if (frameInFlight >= frames.size()) {
+        return;
+    }
+    FrameChanges& frame = frames[frameInFlight];
+    if (frame.changeCount == 0 && !frame.stagingEnd.has_value()) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < frame.changeCount; i++) {
+        const ResidencyChange& change = frame.changes[i];
+        if (change.oldImage != VK_NULL_HANDLE) {
+            vkDestroyImageView(device, change.oldView, allocator);
+            vkDestroyImage(device, change.oldImage, allocator);
+            vkFreeMemory(device, change.oldMemory, allocator);
+            textureBytes -= change.oldMemorySize;
+            retiringBytes -= change.oldMemorySize;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (uint32_t i = 0; i < frame.changeCount; i++) {
+            textures[frame.changes[i].texture]->busy = false;
+        }
+        if (frame.stagingEnd.has_value()) {
+            stagingTail = std::max(stagingTail, frame.stagingEnd.value());
+        }
+    }
+    frame.changeCount = 0;
+    frame.stagingEnd = std::nullopt;
+    loaderWakeup.notify_all();
+}
+
+void TextureStreamer::printSummary(std::ostream& out) const {
+    uint32_t complete = 0;
+    for (const auto& texture : textures) {
+        if (texture->residentLevel == 0) {
+            complete++;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    out << "texture streaming: " << complete << " of " << textures.size() << " textures fully resident, "
+        << uploadCount << " uploads (" << toMiB(uploadedBytes) << " MiB), " << evictionCount << " evictions, "
+        << "peak " << toMiB(peakTextureBytes) << " MiB of texture memory, "
+        << "staging ring peak " << toMiB(stagingHighWater) << " of " << toMiB(stagingSize) << " MiB\n";
+}
+
+void TextureStreamer::writeStats(std::ostream& out) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    out << "texture_count " << textures.size() << "\n"
+        << "texture_uploads " << uploadCount << "\n"
+        << "texture_evictions " << evictionCount << "\n"
+        << "texture_bytes " << textureBytes - retiringBytes << "\n"
+        << "texture_peak_bytes " << peakTextureBytes << "\n"
+        << "texture_memory_limit " << memoryLimit << "\n";
+    for (size_t i = 0; i < textures.size(); i++) {
+        out << "texture" << i << "_resident_level " << textures[i]->residentLevel << "\n"
+            << "texture" << i << "_level_count " << textures[i]->file.getLevelCount() << "\n";
+    }
+}
+
+void TextureStreamer::loaderLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping) {
+        std::optional<StagedUpload> upload = reserveNextUpload();
+        if (!upload.has_value()) {
+            // Everything loaded, over budget, or the ring is full: wait for the render thread.
+            loaderWakeup.wait(lock);
+            continue;
+        }
+
+        // The reservation is ours alone, so the slow part runs unlocked.
+        lock.unlock();
+        const Ktx2File& file = textures[upload->texture]->file;
+        for (uint32_t level = upload->firstLevel; level < upload->endLevel; level++) {
+            file.prefetchLevel(level);
+        }
+        VkDeviceSize offset = upload->stagingStart % stagingSize;
+        for (uint32_t level = upload->endLevel; level-- > upload->firstLevel;) {
+            const Ktx2Level& levelInfo = file.getLevel(level);
+            std::memcpy(stagingMapped + offset, file.getLevelData(level), static_cast<size_t>(levelInfo.size));
+            offset += alignUp(levelInfo.size, STAGING_ALIGNMENT);
+        }
+        try {
+            createImage(upload.value());
+        } catch (...) {
+            lock.lock();
+            loaderError = std::current_exception();
+            return;
+        }
+        lock.lock();
+
+        staged[(stagedHead + stagedCount) % MAX_STAGED_UPLOADS] = upload.value();
+        stagedCount++;
+    }
+}
+
+std::optional<TextureStreamer::StagedUpload> TextureStreamer::reserveNextUpload() {
+    if (stagedCount == MAX_STAGED_UPLOADS) {
+        return std::nullopt;
+    }
+
+    // Evictions first, they are what frees memory.
+    for (uint32_t i = 0; i < textures.size(); i++) {
+        Texture& texture = *textures[i];
+        if (texture.evictionRequested) {
+            texture.evictionRequested = false;
+            return StagedUpload{i, texture.loadedLevel, texture.loadedLevel, stagingHead, stagingHead, VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE, 0};
+        }
+    }
+
+    // Coarsest first across all textures: the smallest pending upload goes next.
+    std::optional<StagedUpload> best;
+    VkDeviceSize bestSize = 0;
+    for (uint32_t i = 0; i < textures.size(); i++) {
+        const Texture& texture = *textures[i];
+        if (texture.busy || texture.loadedLevel <= texture.finestLoadableLevel) {
+            continue;
+        }
+        uint32_t firstLevel = nextFirstLevel(texture);
+        VkDeviceSize size = stagedSize(texture, firstLevel, texture.loadedLevel);
+        if (!best.has_value() || size < bestSize) {
+            best = StagedUpload{i, firstLevel, texture.loadedLevel, 0, 0, VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE, 0};
+            bestSize = size;
+        }
+    }
+    if (!best.has_value() || stagedBytes + bestSize > loadHeadroom) {
+        return std::nullopt;
+    }
+
+    // Uploads are contiguous in the ring; one that would wrap starts over at the beginning.
+    uint64_t start = stagingHead;
+    VkDeviceSize ringOffset = start % stagingSize;
+    if (ringOffset + bestSize > stagingSize) {
+        start += stagingSize - ringOffset;
+    }
+    if (start + bestSize - stagingTail > stagingSize) {
+        return std::nullopt;
+    }
+    stagingHead = start + bestSize;
+    stagingHighWater = std::max(stagingHighWater, stagingHead - stagingTail);
+
+    best->stagingStart = start;
+    best->stagingEnd = start + bestSize;
+    Texture& texture = *textures[best->texture];
+    texture.busy = true;
+    texture.loadedLevel = best->firstLevel;
+    stagedBytes += bestSize;
+    return best;
+}
+
+// The first upload brings the mip tail, every later one the next finer level.
+uint32_t TextureStreamer::nextFirstLevel(const Texture& texture) const {
+    uint32_t levelCount = texture.file.getLevelCount();
+    if (texture.loadedLevel < levelCount) {
+        return texture.loadedLevel - 1;
+    }
+
+    uint32_t firstLevel = levelCount - 1;
+    while (firstLevel > 0 && stagedSize(texture, firstLevel - 1, levelCount) <= MIP_TAIL_SIZE) {
+        firstLevel--;
+    }
+    return firstLevel;
+}
+
+VkDeviceSize TextureStreamer::stagedSize(const Texture& texture, uint32_t firstLevel, uint32_t endLevel) {
+    VkDeviceSize size = 0;
+    for (uint32_t level = firstLevel; level < endLevel; level++) {
+        size += alignUp(texture.file.getLevel(level).size, STAGING_ALIGNMENT);
+    }
+    return size;
+}
+
+// Publishes how much the loader may stage and returns whether levels have to be evicted.
+// The heap budget and memoryLimit are separate limits: the fractions of memoryLimit apply
+// to the texture memory alone, not to whatever else the process has on the heap.
+bool TextureStreamer::updateBudget() {
+    // Images retired by frames in flight are as good as freed.
+    VkDeviceSize liveTextureBytes = textureBytes - retiringBytes;
+    VkDeviceSize heapUsage = liveTextureBytes;
+    VkDeviceSize heapBudget = fraction(heapSize, FALLBACK_BUDGET_FRACTION);
+    if (useMemoryBudget) {
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+        budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+        VkPhysicalDeviceMemoryProperties2 memProperties{};
+        memProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+        memProperties.pNext = &budgetProperties;
+        vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &memProperties);
+
+        heapUsage = std::max(budgetProperties.heapUsage[heapIndex], textureBytes) - retiringBytes;
+        heapBudget = budgetProperties.heapBudget[heapIndex];
+    }
+
+    auto headroomBelow = [](VkDeviceSize limit, VkDeviceSize used) -> VkDeviceSize { return used < limit ? limit - used : 0; };
+    VkDeviceSize headroom = headroomBelow(fraction(heapBudget, LOAD_BUDGET_FRACTION), heapUsage);
+    bool overBudget = heapUsage > fraction(heapBudget, EVICT_BUDGET_FRACTION);
+    if (memoryLimit != 0) {
+        headroom = std::min(headroom, headroomBelow(fraction(memoryLimit, LOAD_BUDGET_FRACTION), liveTextureBytes));
+        overBudget = overBudget || liveTextureBytes > fraction(memoryLimit, EVICT_BUDGET_FRACTION);
+    }
+
+    bool grew = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        grew = headroom > loadHeadroom;
+        loadHeadroom = headroom;
+    }
+    if (grew) {
+        loaderWakeup.notify_all();
+    }
+
+    return overBudget;
+}
+
+// Asks the loader for an image without the finest resident level of the texture using
+// the most memory. Returns false if no texture can give up a level.
+bool TextureStreamer::requestEviction() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::optional<uint32_t> victim;
+        for (uint32_t i = 0; i < textures.size(); i++) {
+            const Texture& texture = *textures[i];
+            if (texture.busy || texture.residentLevel + 1 >= texture.file.getLevelCount()) {
+                continue; // changing already, or down to its last level
+            }
+            if (!victim.has_value() || texture.memorySize > textures[victim.value()]->memorySize) {
+                victim = i;
+            }
+        }
+        if (!victim.has_value()) {
+            return false;
+        }
+
+        Texture& texture = *textures[victim.value()];
+        texture.busy = true;
+        texture.evictionRequested = true;
+        texture.loadedLevel = texture.residentLevel + 1;
+    }
+    loaderWakeup.notify_all();
+    return true;
+}
+
+// Loader thread: creates the image, memory and view for the levels [upload.firstLevel,
+// levelCount) of the upload's texture.
+void TextureStreamer::createImage(StagedUpload& upload) const {
+    const Ktx2File& file = textures[upload.texture]->file;
+    const Ktx2Level& baseLevel = file.getLevel(upload.firstLevel);
+
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = file.getFormat();
+    imageInfo.extent = {baseLevel.width, baseLevel.height, 1};
+    imageInfo.mipLevels = file.getLevelCount() - upload.firstLevel;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    if (vkCreateImage(device, &imageInfo, allocator, &upload.image) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create texture image!");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(device, upload.image, &memRequirements);
+
+    std::optional<uint32_t> memoryType = findMemoryType(physicalDevice, memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    if (!memoryType.has_value()) {
+        destroyImage(upload);
+        throw std::runtime_error("failed to find device local memory for textures!");
+    }
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = memoryType.value();
+
+    if (vkAllocateMemory(device, &allocInfo, allocator, &upload.memory) != VK_SUCCESS) {
+        destroyImage(upload);
+        throw std::runtime_error("failed to allocate texture image memory!");
+    }
+    vkBindImageMemory(device, upload.image, upload.memory, 0);
+    upload.memorySize = memRequirements.size;
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = upload.image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = imageInfo.format;
+    viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, imageInfo.mipLevels, 0, 1};
+
+    if (vkCreateImageView(device, &viewInfo, allocator, &upload.view) != VK_SUCCESS) {
+        destroyImage(upload);
+        throw std::runtime_error("failed to create texture image view!");
+    }
+}
+
+void TextureStreamer::destroyImage(const StagedUpload& upload) const {
+    vkDestroyImageView(device, upload.view, allocator);
+    vkDestroyImage(device, upload.image, allocator);
+    vkFreeMemory(device, upload.memory, allocator);
+}
+
+// Copies the upload's staged levels into its image, which is in TRANSFER_DST_OPTIMAL.
+void TextureStreamer::recordStagedCopy(VkCommandBuffer commandBuffer, const StagedUpload& upload) const {
+    const Ktx2File& file = textures[upload.texture]->file;
+    std::array<VkBufferImageCopy, MAX_LEVELS> regions{};
+    uint32_t regionCount = 0;
+    VkDeviceSize offset = upload.stagingStart % stagingSize;
+    // Staged coarsest first, like the file stores them.
+    for (uint32_t level = upload.endLevel; level-- > upload.firstLevel;) {
+        VkBufferImageCopy& region = regions[regionCount++];
+        region.bufferOffset = offset;
+        region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - upload.firstLevel, 0, 1};
+        region.imageExtent = {file.getLevel(level).width, file.getLevel(level).height, 1};
+        offset += alignUp(file.getLevel(level).size, STAGING_ALIGNMENT);
+    }
+    vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, upload.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, regionCount, regions.data());
+}
+
+// Transfer queue: copies the staged levels into the new image and releases it to the
+// graphics family, still in TRANSFER_DST_OPTIMAL for the levels replaceImage() copies over.
+void TextureStreamer::recordTransfer(VkCommandBuffer transferCommandBuffer, const StagedUpload& upload) const {
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = upload.image;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, textures[upload.texture]->file.getLevelCount() - upload.firstLevel, 0, 1};
+    vkCmdPipelineBarrier(transferCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+        0, nullptr, 0, nullptr, 1, &barrier);
+
+    recordStagedCopy(transferCommandBuffer, upload);
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = 0;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = transferFamily;
+    barrier.dstQueueFamilyIndex = graphicsFamily;
+    vkCmdPipelineBarrier(transferCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+        0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+// Replaces the texture's image by the one the loader prepared for the levels
+// [upload.firstLevel, levelCount): the levels the old image has are copied over, the
+// others come from the staging ring, or were already copied on the transfer queue
+// (transferred), in which case the image is acquired from there.
+void TextureStreamer::replaceImage(VkCommandBuffer commandBuffer, const StagedUpload& upload, bool transferred, FrameChanges& frame) {
+    Texture& texture = *textures[upload.texture];
+    const Ktx2File& file = texture.file;
+    uint32_t levelCount = file.getLevelCount();
+    uint32_t oldResidentLevel = texture.residentLevel;
+    uint32_t newResidentLevel = upload.firstLevel;
+
+    // Earlier frames may still sample the old image, the new one has no contents yet.
+    VkImageMemoryBarrier toTransfer[2]{};
+    toTransfer[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    toTransfer[0].srcAccessMask = 0;
+    toTransfer[0].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    toTransfer[0].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    toTransfer[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    toTransfer[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toTransfer[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toTransfer[0].image = upload.image;
+    toTransfer[0].subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount - newResidentLevel, 0, 1};
+
+    toTransfer[1] = toTransfer[0];
+    toTransfer[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    toTransfer[1].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    toTransfer[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    toTransfer[1].image = texture.image;
+    toTransfer[1].subresourceRange.levelCount = levelCount - oldResidentLevel;
+
+    // The acquire matching recordTransfer()'s release; UPLOAD_WAIT_STAGE orders it after.
+    VkPipelineStageFlags srcStages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    if (transferred) {
+        toTransfer[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        toTransfer[0].srcQueueFamilyIndex = transferFamily;
+        toTransfer[0].dstQueueFamilyIndex = graphicsFamily;
+        srcStages |= UPLOAD_WAIT_STAGE;
+    }
+
+    bool hasOldImage = texture.image != VK_NULL_HANDLE;
+    vkCmdPipelineBarrier(commandBuffer, srcStages, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+        0, nullptr, 0, nullptr, hasOldImage ? 2 : 1, toTransfer);
+
+    uint32_t firstCommonLevel = std::max(newResidentLevel, oldResidentLevel);
+    if (hasOldImage && firstCommonLevel < levelCount) {
+        std::array<VkImageCopy, MAX_LEVELS> regions{};
+        uint32_t regionCount = 0;
+        for (uint32_t level = firstCommonLevel; level < levelCount; level++) {
+            VkImageCopy& region = regions[regionCount++];
+            region.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - oldResidentLevel, 0, 1};
+            region.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - newResidentLevel, 0, 1};
+            region.extent = {file.getLevel(level).width, file.getLevel(level).height, 1};
+        }
+        vkCmdCopyImage(commandBuffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, upload.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, regionCount, regions.data());
+    }
+
+    if (!transferred && upload.endLevel > upload.firstLevel) {
+        recordStagedCopy(commandBuffer, upload);
+    }
+
+    VkImageMemoryBarrier toShader = toTransfer[0];
+    toShader.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    toShader.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    toShader.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    toShader.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    toShader.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toShader.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+        0, nullptr, 0, nullptr, 1, &toShader);
+
+    frame.changes[frame.changeCount++] = ResidencyChange{upload.texture, texture.image, texture.memory, texture.view, texture.memorySize};
+    retiringBytes += texture.memorySize;
+    textureBytes += upload.memorySize;
+    peakTextureBytes = std::max(peakTextureBytes, textureBytes);
+
+    texture.image = upload.image;
+    texture.memory = upload.memory;
+    texture.view = upload.view;
+    texture.memorySize = upload.memorySize;
+    texture.residentLevel = newResidentLevel;
+}
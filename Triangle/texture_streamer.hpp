@@ -0,0 +1,240 @@
+#pragma once
+
+#include "ktx2.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Streams the mip levels of KTX2 textures into device local images, coarsest first, and
+// evicts the finest ones again when device memory runs short.
+//
+// A loader thread reads the memory mapped files into a host visible staging ring; the
+// render thread records the copies (recordUploads()) and the ring space comes back once
+// that frame's fence has signaled (frameCompleted()). Page faults on the files, and so
+// disk reads, only ever stall the loader.
+//
+// With a transfer family apart from the graphics one, the copies out of the staging ring
+// run on the transfer queue, which then releases the new images to the graphics family;
+// the frame command buffer acquires them once the frame's submission has waited on
+// getUploadSemaphore(). Otherwise everything is recorded into the frame command buffer.
+//
+// Each texture is one image holding its resident levels, from the finest resident one
+// down to 1x1. Making a level resident or evicting one replaces the image by one with a
+// level more or less; the levels both have in common are copied over on the GPU and the
+// old image is destroyed once no frame in flight can use it anymore. The loader creates
+// the new image, its memory and view too (an eviction is requested from it like an
+// upload), so the render thread only records copies and barriers.
+//
+// The budget comes from VK_EXT_memory_budget when the device has it (the heap's budget and
+// usage of the whole process); without it, textures get FALLBACK_BUDGET_FRACTION of the
+// heap. New levels are loaded while usage stays below LOAD_BUDGET_FRACTION of the budget,
+// and levels are evicted, largest textures first, while it is above EVICT_BUDGET_FRACTION.
+// A memoryLimit is a second budget, with the same fractions, for the textures alone.
+class TextureStreamer {
+public:
+    static constexpr VkDeviceSize DEFAULT_STAGING_SIZE = 32 * 1024 * 1024;
+    // Where the graphics submission waits on getUploadSemaphore().
+    static constexpr VkPipelineStageFlags UPLOAD_WAIT_STAGE = VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+    TextureStreamer();
+    ~TextureStreamer();
+
+    TextureStreamer(const TextureStreamer& source) = delete;
+    TextureStreamer& operator=(const TextureStreamer& source) = delete;
+
+    // transferQueue is from transferFamily, which may be graphicsFamily. useMemoryBudget:
+    // VK_EXT_memory_budget is enabled on the device. memoryLimit, if not 0, additionally
+    // caps the device memory all textures together may use.
+    void create(VkDevice device, VkPhysicalDevice physicalDevice, const VkAllocationCallbacks* allocator, uint32_t framesInFlight,
+        uint32_t graphicsFamily, uint32_t transferFamily, VkQueue transferQueue,
+        bool useMemoryBudget, VkDeviceSize memoryLimit = 0, VkDeviceSize stagingSize = DEFAULT_STAGING_SIZE);
+    // Stops the loader and destroys every texture; call with the device idle.
+    void destroy();
+
+    // Maps the file and queues its levels for streaming. Throws if the file or its format
+    // is not supported. Returns the texture's index.
+    uint32_t addTexture(const std::string& filename);
+    // Starts the loader thread once all textures have been added.
+    void start();
+
+    // Records the copies of the levels the loader has staged, and of the evictions it has
+    // prepared, for the frame using frameInFlight's fence; requests an eviction if memory is
+    // short. Rethrows the loader's errors. Record before any pass samples the textures:
+    // images and views of textures whose residency changed are replaced. Copies that go
+    // to the transfer queue are submitted right away.
+    void recordUploads(VkCommandBuffer commandBuffer, uint32_t frameInFlight);
+    // What the frame's graphics submission has to wait on at UPLOAD_WAIT_STAGE, or
+    // VK_NULL_HANDLE if recordUploads() submitted nothing to the transfer queue.
+    VkSemaphore getUploadSemaphore(uint32_t frameInFlight) const {
+        return frames[frameInFlight].transferSubmitted ? frames[frameInFlight].transferFinished : VK_NULL_HANDLE;
+    }
+    // Called once frameInFlight's fence has signaled.
+    void frameCompleted(uint32_t frameInFlight);
+
+    uint32_t getTextureCount() const { return static_cast<uint32_t>(textures.size()); }
+    // In SHADER_READ_ONLY_OPTIMAL layout, VK_NULL_HANDLE until the first levels arrived.
+    // Changes whenever the residency does, so descriptors have to be updated per frame.
+    VkImageView getView(uint32_t texture) const { return textures[texture]->view; }
+    // Finest resident level of the file, getLevelCount() of the file while none is.
+    uint32_t getResidentLevel(uint32_t texture) const { return textures[texture]->residentLevel; }
+    // Trilinear, repeating; works with every view since views only cover resident levels.
+    VkSampler getSampler() const { return sampler; }
+
+    void printSummary(std::ostream& out) const;
+    // Writes the streaming counters and every texture's residency as "key value" lines,
+    // for the --stats file. Call once the render thread is done.
+    void writeStats(std::ostream& out) const;
+
+private:
+    static constexpr double FALLBACK_BUDGET_FRACTION = 0.5;
+    static constexpr double LOAD_BUDGET_FRACTION = 0.8;
+    static constexpr double EVICT_BUDGET_FRACTION = 0.9;
+    // Levels up to this size are loaded together with the coarsest one, in one image.
+    static constexpr VkDeviceSize MIP_TAIL_SIZE = 64 * 1024;
+    // Residency changes recorded per frame, and the staging bytes they may copy (a single
+    // larger upload still goes through, alone).
+    static constexpr uint32_t MAX_CHANGES_PER_FRAME = 4;
+    static constexpr VkDeviceSize MAX_UPLOAD_BYTES_PER_FRAME = 8 * 1024 * 1024;
+    static constexpr uint32_t MAX_STAGED_UPLOADS = 16;
+    static constexpr VkDeviceSize STAGING_ALIGNMENT = 16; // a multiple of every texel block size
+
+    struct Texture {
+        Ktx2File file;
+        // Render thread only.
+        VkImage image;
+        VkDeviceMemory memory;
+        VkImageView view;
+        VkDeviceSize memorySize;
+        uint32_t residentLevel;
+        // Guarded by mutex.
+        uint32_t loadedLevel; // finest level that is resident or staged
+        uint32_t finestLoadableLevel; // finer levels do not fit into the staging ring
+        bool busy; // a residency change is requested, staged or in flight, nothing else may start
+        bool evictionRequested; // the loader is to prepare an image without the finest level
+        Texture()
+            : file()
+            , image(VK_NULL_HANDLE)
+            , memory(VK_NULL_HANDLE)
+            , view(VK_NULL_HANDLE)
+            , memorySize(0)
+            , residentLevel(0)
+            , loadedLevel(0)
+            , finestLoadableLevel(0)
+            , busy(false)
+            , evictionRequested(false)
+        {}
+
+        Texture(const Texture& source) = delete;
+        Texture& operator=(const Texture& source) = delete;
+    };
+
+    // A residency change the loader has prepared: the new image for the levels
+    // [firstLevel, levelCount), and levels [firstLevel, endLevel) staged at stagingStart,
+    // each at an offset aligned to STAGING_ALIGNMENT. endLevel is the texture's
+    // residentLevel, or firstLevel for an eviction, which stages nothing.
+    struct StagedUpload {
+        uint32_t texture;
+        uint32_t firstLevel;
+        uint32_t endLevel;
+        uint64_t stagingStart; // position in the ring, counting up without wrapping
+        uint64_t stagingEnd;
+        VkImage image;
+        VkDeviceMemory memory;
+        VkImageView view;
+        VkDeviceSize memorySize;
+    };
+
+    // A residency change recorded in a frame. Once the frame has completed, the image it
+    // replaced (none for a texture's first upload) is destroyed and the texture is free
+    // for the next change.
+    struct ResidencyChange {
+        uint32_t texture;
+        VkImage oldImage;
+        VkDeviceMemory oldMemory;
+        VkImageView oldView;
+        VkDeviceSize oldMemorySize;
+    };
+
+    struct FrameChanges {
+        std::array<ResidencyChange, MAX_CHANGES_PER_FRAME> changes;
+        uint32_t changeCount;
+        std::optional<uint64_t> stagingEnd; // ring space consumed by the frame's uploads
+        // Only with a separate transfer family.
+        VkCommandBuffer transferCommandBuffer;
+        VkSemaphore transferFinished;
+        bool transferSubmitted;
+    };
+
+    VkDevice device;
+    VkPhysicalDevice physicalDevice;
+    const VkAllocationCallbacks* allocator;
+    uint32_t graphicsFamily;
+    uint32_t transferFamily;
+    VkQueue transferQueue;
+    VkCommandPool transferCommandPool; // VK_NULL_HANDLE if the families are the same
+    bool useMemoryBudget;
+    VkDeviceSize memoryLimit;
+    uint32_t heapIndex; // of device local memory, where the budget is watched
+    VkDeviceSize heapSize;
+
+    VkSampler sampler;
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingMemory;
+    std::byte* stagingMapped;
+    VkDeviceSize stagingSize;
+
+    std::vector<std::unique_ptr<Texture>> textures;
+    std::vector<FrameChanges> frames; // indexed by frame in flight
+
+    // Render thread only.
+    VkDeviceSize textureBytes; // device memory of every texture image, retired ones included
+    VkDeviceSize retiringBytes; // part of textureBytes waiting for frameCompleted()
+    bool evictionPending; // requested from the loader and not recorded yet
+
+    // Guards the loader's view of the textures, the ring and the staged uploads.
+    mutable std::mutex mutex;
+    std::condition_variable loaderWakeup;
+    uint64_t stagingHead;
+    uint64_t stagingTail;
+    std::array<StagedUpload, MAX_STAGED_UPLOADS> staged; // ring of uploads waiting to be recorded
+    uint32_t stagedHead;
+    uint32_t stagedCount;
+    VkDeviceSize loadHeadroom; // bytes the loader may still stage, set by the render thread
+    VkDeviceSize stagedBytes; // staged but not recorded yet, counted against loadHeadroom
+    bool stopping;
+    std::exception_ptr loaderError; // rethrown on the render thread, the loader stops
+
+    uint64_t uploadCount;
+    uint64_t uploadedBytes;
+    uint64_t evictionCount;
+    VkDeviceSize peakTextureBytes;
+    uint64_t stagingHighWater;
+
+    std::thread loader;
+
+    void stopLoader();
+    void loaderLoop();
+    std::optional<StagedUpload> reserveNextUpload();
+    uint32_t nextFirstLevel(const Texture& texture) const;
+    static VkDeviceSize stagedSize(const Texture& texture, uint32_t firstLevel, uint32_t endLevel);
+
+    void createImage(StagedUpload& upload) const;
+    void destroyImage(const StagedUpload& upload) const;
+
+    bool updateBudget();
+    bool requestEviction();
+    void recordStagedCopy(VkCommandBuffer commandBuffer, const StagedUpload& upload) const;
+    void recordTransfer(VkCommandBuffer transferCommandBuffer, const StagedUpload& upload) const;
+    void replaceImage(VkCommandBuffer commandBuffer, const StagedUpload& upload, bool transferred, FrameChanges& frame);
+};
@@ -0,0 +1,771 @@
+#include "mesh_import.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+
+std::vector<char> readFile(const std::string& filename) {
+    std::ifstream file(filename, std::ios::ate | std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("failed to open " + filename + "!");
+    }
+
+    size_t fileSize = static_cast<size_t>(file.tellg());
+    std::vector<char> buffer(fileSize);
+    file.seekg(0);
+    file.read(buffer.data(), static_cast<std::streamsize>(fileSize));
+    return buffer;
+}
+
+// --- OBJ ---
+
+struct ObjCorner {
+    long position;
+    long uv;
+    long normal;
+};
+
+struct ObjCornerHash {
+    size_t operator()(const ObjCorner& corner) const {
+        return static_cast<size_t>(corner.position) * 73856093u ^ static_cast<size_t>(corner.uv) * 19349663u ^ static_cast<size_t>(corner.normal) * 83492791u;
+    }
+};
+
+bool operator==(const ObjCorner& a, const ObjCorner& b) {
+    return a.position == b.position && a.uv == b.uv && a.normal == b.normal;
+}
+
+// OBJ indices count from 1, negative ones from the end; -1 here means none.
+long resolveObjIndex(long index, size_t count) {
+    if (index > 0) {
+        return index - 1;
+    }
+    if (index < 0) {
+        return static_cast<long>(count) + index;
+    }
+    return -1;
+}
+
+// --- JSON, as much as glTF needs ---
+
+struct Json {
+    enum class Type { Null, Boolean, Number, String, Array, Object };
+
+    Type type;
+    bool boolean;
+    double number;
+    std::string string;
+    std::vector<Json> items;        // array elements, or object values
+    std::vector<std::string> keys;  // object keys, parallel to items
+    Json()
+        : type(Type::Null)
+        , boolean(false)
+        , number(0.0)
+        , string()
+        , items()
+        , keys()
+    {}
+
+    const Json* find(const std::string& key) const {
+        for (size_t i = 0; i < keys.size(); i++) {
+            if (keys[i] == key) {
+                return &items[i];
+            }
+        }
+        return nullptr;
+    }
+
+    const Json& operator[](const std::string& key) const {
+        const Json* value = find(key);
+        if (value == nullptr) {
+            throw std::runtime_error("glTF: missing \"" + key + "\"!");
+        }
+        return *value;
+    }
+
+    const Json& operator[](size_t index) const {
+        if (index >= items.size()) {
+            throw std::runtime_error("glTF: index " + std::to_string(index) + " out of range!");
+        }
+        return items[index];
+    }
+
+    size_t index() const { return static_cast<size_t>(number); }
+    size_t indexOr(const std::string& key, size_t fallback) const {
+        const Json* value = find(key);
+        return value != nullptr ? value->index() : fallback;
+    }
+};
+
+class JsonParser {
+public:
+    JsonParser(const char* text, size_t size)
+        : text(text)
+        , size(size)
+        , pos(0)
+    {}
+
+    Json parse() {
+        Json value = parseValue();
+        skipWhitespace();
+        if (pos != size) {
+            fail("trailing characters");
+        }
+        return value;
+    }
+
+private:
+    const char* text;
+    size_t size;
+    size_t pos;
+
+    [[noreturn]] void fail(const std::string& message) const {
+        throw std::runtime_error("glTF: invalid JSON at byte " + std::to_string(pos) + ": " + message + "!");
+    }
+
+    void skipWhitespace() {
+        while (pos < size && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r')) {
+            pos++;
+        }
+    }
+
+    void expect(char c) {
+        skipWhitespace();
+        if (pos >= size || text[pos] != c) {
+            fail(std::string("expected '") + c + "'");
+        }
+        pos++;
+    }
+
+    bool consume(const char* word) {
+        size_t length = std::strlen(word);
+        if (size - pos >= length && std::strncmp(text + pos, word, length) == 0) {
+            pos += length;
+            return true;
+        }
+        return false;
+    }
+
+    Json parseValue() {
+        skipWhitespace();
+        if (pos >= size) {
+            fail("unexpected end");
+        }
+
+        Json value;
+        char c = text[pos];
+        if (c == '{') {
+            value.type = Json::Type::Object;
+            pos++;
+            skipWhitespace();
+            if (pos < size && text[pos] == '}') {
+                pos++;
+                return value;
+            }
+            do {
+                skipWhitespace();
+                value.keys.push_back(parseString());
+                expect(':');
+                value.items.push_back(parseValue());
+                skipWhitespace();
+            } while (pos < size && text[pos] == ',' && ++pos);
+            expect('}');
+        } else if (c == '[') {
+            value.type = Json::Type::Array;
+            pos++;
+            skipWhitespace();
+            if (pos < size && text[pos] == ']') {
+                pos++;
+                return value;
+            }
+            do {
+                value.items.push_back(parseValue());
+                skipWhitespace();
+            } while (pos < size && text[pos] == ',' && ++pos);
+            expect(']');
+        } else if (c == '"') {
+            value.type = Json::Type::String;
+            value.string = parseString();
+        } else if (consume("true")) {
+            value.type = Json::Type::Boolean;
+            value.boolean = true;
+        } else if (consume("false")) {
+            value.type = Json::Type::Boolean;
+        } else if (consume("null")) {
+            value.type = Json::Type::Null;
+        } else {
+            // The text is not null terminated (GLB chunks), so strtod gets a copy.
+            size_t end = pos;
+            while (end < size && text[end] != '\0' && std::strchr("+-0123456789.eE", text[end]) != nullptr) {
+                end++;
+            }
+            std::string number(text + pos, end - pos);
+            char* parsed = nullptr;
+            value.type = Json::Type::Number;
+            value.number = std::strtod(number.c_str(), &parsed);
+            if (number.empty() || parsed != number.c_str() + number.size()) {
+                fail("expected a value");
+            }
+            pos = end;
+        }
+        return value;
+    }
+
+    std::string parseString() {
+        if (pos >= size || text[pos] != '"') {
+            fail("expected a string");
+        }
+        pos++;
+
+        std::string result;
+        while (pos < size && text[pos] != '"') {
+            char c = text[pos++];
+            if (c != '\\') {
+                result += c;
+                continue;
+            }
+            if (pos >= size) {
+                break;
+            }
+            char escaped = text[pos++];
+            switch (escaped) {
+            case 'b': result += '\b'; break;
+            case 'f': result += '\f'; break;
+            case 'n': result += '\n'; break;
+            case 'r': result += '\r'; break;
+            case 't': result += '\t'; break;
+            case 'u': appendCodePoint(result, parseCodePoint()); break;
+            default: result += escaped; break;
+            }
+        }
+        expect('"');
+        return result;
+    }
+
+    uint32_t parseHex4() {
+        if (size - pos < 4) {
+            fail("short \\u escape");
+        }
+        std::string digits(text + pos, 4);
+        pos += 4;
+        return static_cast<uint32_t>(std::strtoul(digits.c_str(), nullptr, 16));
+    }
+
+    uint32_t parseCodePoint() {
+        uint32_t codePoint = parseHex4();
+        if (codePoint >= 0xd800 && codePoint < 0xdc00 && consume("\\u")) {
+            uint32_t low = parseHex4();
+            codePoint = 0x10000 + ((codePoint - 0xd800) << 10) + (low - 0xdc00);
+        }
+        return codePoint;
+    }
+
+    static void appendCodePoint(std::string& out, uint32_t codePoint) {
+        if (codePoint < 0x80) {
+            out += static_cast<char>(codePoint);
+        } else if (codePoint < 0x800) {
+            out += static_cast<char>(0xc0 | (codePoint >> 6));
+            out += static_cast<char>(0x80 | (codePoint & 0x3f));
+        } else if (codePoint < 0x10000) {
+            out += static_cast<char>(0xe0 | (codePoint >> 12));
+            out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (codePoint & 0x3f));
+        } else {
+            out += static_cast<char>(0xf0 | (codePoint >> 18));
+            out += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3f));
+            out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (codePoint & 0x3f));
+        }
+    }
+};
+
+// --- glTF ---
+
+const uint32_t GLB_MAGIC = 0x46546c67; // "glTF"
+const uint32_t GLB_CHUNK_JSON = 0x4e4f534a;
+const uint32_t GLB_CHUNK_BIN = 0x004e4942;
+
+const uint32_t GLTF_BYTE = 5120;
+const uint32_t GLTF_UNSIGNED_BYTE = 5121;
+const uint32_t GLTF_SHORT = 5122;
+const uint32_t GLTF_UNSIGNED_SHORT = 5123;
+const uint32_t GLTF_UNSIGNED_INT = 5125;
+const uint32_t GLTF_FLOAT = 5126;
+const uint32_t GLTF_TRIANGLES = 4;
+
+// Column major, like glTF stores them.
+using Matrix = std::array<float, 16>;
+
+const Matrix IDENTITY = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+
+Matrix multiply(const Matrix& a, const Matrix& b) {
+    Matrix result{};
+    for (size_t column = 0; column < 4; column++) {
+        for (size_t row = 0; row < 4; row++) {
+            float sum = 0.0f;
+            for (size_t k = 0; k < 4; k++) {
+                sum += a[k * 4 + row] * b[column * 4 + k];
+            }
+            result[column * 4 + row] = sum;
+        }
+    }
+    return result;
+}
+
+std::array<float, 3> transformPoint(const Matrix& m, const std::array<float, 3>& p) {
+    return {
+        m[0] * p[0] + m[4] * p[1] + m[8] * p[2] + m[12],
+        m[1] * p[0] + m[5] * p[1] + m[9] * p[2] + m[13],
+        m[2] * p[0] + m[6] * p[1] + m[10] * p[2] + m[14]
+    };
+}
+
+// Normals transform with the inverse transpose of the upper 3x3, which up to a scale factor
+// is its cofactor matrix.
+std::array<float, 3> transformNormal(const Matrix& m, const std::array<float, 3>& n) {
+    auto at = [&m](size_t row, size_t column) { return m[column * 4 + row]; };
+    float c[3][3];
+    for (size_t row = 0; row < 3; row++) {
+        for (size_t column = 0; column < 3; column++) {
+            size_t r0 = (row + 1) % 3, r1 = (row + 2) % 3;
+            size_t c0 = (column + 1) % 3, c1 = (column + 2) % 3;
+            c[row][column] = at(r0, c0) * at(r1, c1) - at(r0, c1) * at(r1, c0);
+        }
+    }
+    std::array<float, 3> result = {
+        c[0][0] * n[0] + c[0][1] * n[1] + c[0][2] * n[2],
+        c[1][0] * n[0] + c[1][1] * n[1] + c[1][2] * n[2],
+        c[2][0] * n[0] + c[2][1] * n[1] + c[2][2] * n[2]
+    };
+    float length = std::sqrt(result[0] * result[0] + result[1] * result[1] + result[2] * result[2]);
+    if (length > 0.0f) {
+        for (float& component : result) {
+            component /= length;
+        }
+    }
+    return result;
+}
+
+Matrix nodeMatrix(const Json& node) {
+    if (const Json* matrix = node.find("matrix")) {
+        Matrix result{};
+        for (size_t i = 0; i < 16; i++) {
+            result[i] = static_cast<float>((*matrix)[i].number);
+        }
+        return result;
+    }
+
+    float t[3] = {0, 0, 0}, r[4] = {0, 0, 0, 1}, s[3] = {1, 1, 1};
+    if (const Json* translation = node.find("translation")) {
+        for (size_t i = 0; i < 3; i++) t[i] = static_cast<float>((*translation)[i].number);
+    }
+    if (const Json* rotation = node.find("rotation")) {
+        for (size_t i = 0; i < 4; i++) r[i] = static_cast<float>((*rotation)[i].number);
+    }
+    if (const Json* scale = node.find("scale")) {
+        for (size_t i = 0; i < 3; i++) s[i] = static_cast<float>((*scale)[i].number);
+    }
+
+    // T * R * S, with R from the unit quaternion (x, y, z, w).
+    float x = r[0], y = r[1], z = r[2], w = r[3];
+    return {
+        (1 - 2 * (y * y + z * z)) * s[0], (2 * (x * y + z * w)) * s[0], (2 * (x * z - y * w)) * s[0], 0,
+        (2 * (x * y - z * w)) * s[1], (1 - 2 * (x * x + z * z)) * s[1], (2 * (y * z + x * w)) * s[1], 0,
+        (2 * (x * z + y * w)) * s[2], (2 * (y * z - x * w)) * s[2], (1 - 2 * (x * x + y * y)) * s[2], 0,
+        t[0], t[1], t[2], 1
+    };
+}
+
+std::vector<char> decodeBase64(const std::string& text) {
+    std::vector<char> result;
+    result.reserve(text.size() / 4 * 3);
+    uint32_t bits = 0;
+    int bitCount = 0;
+    for (char c : text) {
+        int value;
+        if (c >= 'A' && c <= 'Z') value = c - 'A';
+        else if (c >= 'a' && c <= 'z') value = c - 'a' + 26;
+        else if (c >= '0' && c <= '9') value = c - '0' + 52;
+        else if (c == '+' || c == '-') value = 62;
+        else if (c == '/' || c == '_') value = 63;
+        else continue; // padding, whitespace
+        bits = (bits << 6) | static_cast<uint32_t>(value);
+        bitCount += 6;
+        if (bitCount >= 8) {
+            bitCount -= 8;
+            result.push_back(static_cast<char>((bits >> bitCount) & 0xff));
+        }
+    }
+    return result;
+}
+
+std::string decodeUri(const std::string& uri) {
+    std::string result;
+    for (size_t i = 0; i < uri.size(); i++) {
+        if (uri[i] == '%' && i + 2 < uri.size()) {
+            result += static_cast<char>(std::strtoul(uri.substr(i + 1, 2).c_str(), nullptr, 16));
+            i += 2;
+        } else {
+            result += uri[i];
+        }
+    }
+    return result;
+}
+
+class GltfImporter {
+public:
+    explicit GltfImporter(const std::string& filename)
+        : filename(filename)
+        , file(readFile(filename))
+        , json()
+        , buffers()
+        , mesh()
+    {}
+
+    ImportedMesh import() {
+        std::vector<char> glbBinary;
+        uint32_t magic = 0;
+        if (file.size() >= 12) {
+            std::memcpy(&magic, file.data(), 4);
+        }
+        if (magic == GLB_MAGIC) {
+            // 12 byte header, then chunks of (length, type, data).
+            size_t offset = 12;
+            while (offset + 8 <= file.size()) {
+                uint32_t chunk[2];
+                std::memcpy(chunk, file.data() + offset, 8);
+                offset += 8;
+                if (chunk[0] > file.size() - offset) {
+                    throw std::runtime_error(filename + " has a broken GLB chunk!");
+                }
+                if (chunk[1] == GLB_CHUNK_JSON) {
+                    json = JsonParser(file.data() + offset, chunk[0]).parse();
+                } else if (chunk[1] == GLB_CHUNK_BIN) {
+                    glbBinary.assign(file.data() + offset, file.data() + offset + chunk[0]);
+                }
+                offset += (chunk[0] + 3) / 4 * 4;
+            }
+        } else {
+            json = JsonParser(file.data(), file.size()).parse();
+        }
+
+        if (const Json* buffersJson = json.find("buffers")) {
+            for (const Json& buffer : buffersJson->items) {
+                buffers.push_back(loadBuffer(buffer, glbBinary));
+            }
+        }
+
+        const Json* scenes = json.find("scenes");
+        if (scenes != nullptr && !scenes->items.empty()) {
+            const Json& scene = (*scenes)[json.indexOr("scene", 0)];
+            if (const Json* nodes = scene.find("nodes")) {
+                for (const Json& node : nodes->items) {
+                    addNode(node.index(), IDENTITY, 0);
+                }
+            }
+        } else if (const Json* meshes = json.find("meshes")) {
+            // No scene: every mesh as is.
+            for (size_t i = 0; i < meshes->items.size(); i++) {
+                addMesh((*meshes)[i], IDENTITY);
+            }
+        }
+
+        if (mesh.indices.empty()) {
+            throw std::runtime_error(filename + " has no triangles!");
+        }
+        return std::move(mesh);
+    }
+
+private:
+    std::string filename;
+    std::vector<char> file;
+    Json json;
+    std::vector<std::vector<char>> buffers;
+    ImportedMesh mesh;
+
+    std::vector<char> loadBuffer(const Json& buffer, const std::vector<char>& glbBinary) {
+        const Json* uri = buffer.find("uri");
+        if (uri == nullptr) {
+            return glbBinary;
+        }
+        if (uri->string.rfind("data:", 0) == 0) {
+            size_t comma = uri->string.find(',');
+            if (comma == std::string::npos || uri->string.rfind(";base64", comma) == std::string::npos) {
+                throw std::runtime_error(filename + ": only base64 data URIs are supported!");
+            }
+            return decodeBase64(uri->string.substr(comma + 1));
+        }
+        return readFile((std::filesystem::path(filename).parent_path() / decodeUri(uri->string)).string());
+    }
+
+    void addNode(size_t nodeIndex, const Matrix& parent, int depth) {
+        if (depth > 64) {
+            throw std::runtime_error(filename + " has a node cycle!");
+        }
+        const Json& node = json["nodes"][nodeIndex];
+        Matrix world = multiply(parent, nodeMatrix(node));
+        if (const Json* meshIndex = node.find("mesh")) {
+            addMesh(json["meshes"][meshIndex->index()], world);
+        }
+        if (const Json* children = node.find("children")) {
+            for (const Json& child : children->items) {
+                addNode(child.index(), world, depth + 1);
+            }
+        }
+    }
+
+    void addMesh(const Json& meshJson, const Matrix& transform) {
+        for (const Json& primitive : meshJson["primitives"].items) {
+            if (primitive.indexOr("mode", GLTF_TRIANGLES) != GLTF_TRIANGLES) {
+                continue; // points and lines have no place in a triangle mesh
+            }
+            const Json& attributes = primitive["attributes"];
+
+            std::vector<float> positions = readAccessor(attributes["POSITION"].index(), 3);
+            size_t vertexCount = positions.size() / 3;
+            std::vector<float> normals;
+            if (const Json* normal = attributes.find("NORMAL")) {
+                normals = readAccessor(normal->index(), 3);
+            }
+            std::vector<float> uvs;
+            if (const Json* uv = attributes.find("TEXCOORD_0")) {
+                uvs = readAccessor(uv->index(), 2);
+            }
+
+            // Attributes missing from some primitives but present in others are filled with
+            // zeros; the converter regenerates zero normals.
+            size_t base = mesh.positions.size();
+            bool hadNormals = !mesh.normals.empty() || base == 0;
+            bool hadUvs = !mesh.uvs.empty() || base == 0;
+            if (!normals.empty() && !hadNormals) {
+                mesh.normals.resize(base, {0.0f, 0.0f, 0.0f});
+            }
+            if (!uvs.empty() && !hadUvs) {
+                mesh.uvs.resize(base, {0.0f, 0.0f});
+            }
+
+            for (size_t i = 0; i < vertexCount; i++) {
+                mesh.positions.push_back(transformPoint(transform, {positions[3 * i], positions[3 * i + 1], positions[3 * i + 2]}));
+                if (!normals.empty()) {
+                    mesh.normals.push_back(transformNormal(transform, {normals[3 * i], normals[3 * i + 1], normals[3 * i + 2]}));
+                } else if (!mesh.normals.empty()) {
+                    mesh.normals.push_back({0.0f, 0.0f, 0.0f});
+                }
+                if (!uvs.empty()) {
+                    mesh.uvs.push_back({uvs[2 * i], uvs[2 * i + 1]});
+                } else if (!mesh.uvs.empty()) {
+                    mesh.uvs.push_back({0.0f, 0.0f});
+                }
+            }
+
+            if (const Json* indices = primitive.find("indices")) {
+                for (uint32_t index : readIndices(indices->index())) {
+                    if (index >= vertexCount) {
+                        throw std::runtime_error(filename + " has an index out of range!");
+                    }
+                    mesh.indices.push_back(static_cast<uint32_t>(base + index));
+                }
+            } else {
+                for (size_t i = 0; i + 2 < vertexCount; i += 3) {
+                    for (size_t corner = 0; corner < 3; corner++) {
+                        mesh.indices.push_back(static_cast<uint32_t>(base + i + corner));
+                    }
+                }
+            }
+        }
+    }
+
+    // Returns the data of the accessor's elements and its element count.
+    const char* accessorData(const Json& accessor, size_t elementSize, size_t& count, size_t& stride) {
+        if (accessor.find("sparse") != nullptr) {
+            throw std::runtime_error(filename + ": sparse accessors are not supported!");
+        }
+        count = accessor["count"].index();
+        const Json& view = json["bufferViews"][accessor["bufferView"].index()];
+        const std::vector<char>& buffer = buffers.at(view["buffer"].index());
+        stride = view.indexOr("byteStride", elementSize);
+        size_t offset = view.indexOr("byteOffset", 0) + accessor.indexOr("byteOffset", 0);
+        if (count > 0 && (offset > buffer.size() || (count - 1) * stride + elementSize > buffer.size() - offset)) {
+            throw std::runtime_error(filename + " has an accessor outside its buffer!");
+        }
+        return buffer.data() + offset;
+    }
+
+    std::vector<float> readAccessor(size_t index, size_t components) {
+        const Json& accessor = json["accessors"][index];
+        uint32_t componentType = static_cast<uint32_t>(accessor["componentType"].index());
+        size_t componentSize = componentType == GLTF_FLOAT ? 4 : (componentType == GLTF_SHORT || componentType == GLTF_UNSIGNED_SHORT) ? 2 : 1;
+
+        size_t count, stride;
+        const char* data = accessorData(accessor, components * componentSize, count, stride);
+
+        std::vector<float> result(count * components);
+        for (size_t i = 0; i < count; i++) {
+            const char* element = data + i * stride;
+            for (size_t c = 0; c < components; c++) {
+                const char* component = element + c * componentSize;
+                float value = 0.0f;
+                // Integer texture coordinates are normalized (the only case glTF allows them).
+                if (componentType == GLTF_FLOAT) {
+                    std::memcpy(&value, component, 4);
+                } else if (componentType == GLTF_UNSIGNED_BYTE) {
+                    value = static_cast<float>(static_cast<uint8_t>(*component)) / 255.0f;
+                } else if (componentType == GLTF_UNSIGNED_SHORT) {
+                    uint16_t raw;
+                    std::memcpy(&raw, component, 2);
+                    value = static_cast<float>(raw) / 65535.0f;
+                } else if (componentType == GLTF_BYTE) {
+                    value = std::max(static_cast<float>(static_cast<int8_t>(*component)) / 127.0f, -1.0f);
+                } else if (componentType == GLTF_SHORT) {
+                    int16_t raw;
+                    std::memcpy(&raw, component, 2);
+                    value = std::max(static_cast<float>(raw) / 32767.0f, -1.0f);
+                } else {
+                    throw std::runtime_error(filename + " has an unsupported attribute component type!");
+                }
+                result[i * components + c] = value;
+            }
+        }
+        return result;
+    }
+
+    std::vector<uint32_t> readIndices(size_t index) {
+        const Json& accessor = json["accessors"][index];
+        uint32_t componentType = static_cast<uint32_t>(accessor["componentType"].index());
+        size_t size = componentType == GLTF_UNSIGNED_INT ? 4 : componentType == GLTF_UNSIGNED_SHORT ? 2 : 1;
+        if (componentType != GLTF_UNSIGNED_INT && componentType != GLTF_UNSIGNED_SHORT && componentType != GLTF_UNSIGNED_BYTE) {
+            throw std::runtime_error(filename + " has an unsupported index type!");
+        }
+
+        size_t count, stride;
+        const char* data = accessorData(accessor, size, count, stride);
+
+        std::vector<uint32_t> result(count);
+        for (size_t i = 0; i < count; i++) {
+            uint32_t value = 0;
+            std::memcpy(&value, data + i * stride, size); // little endian
+            result[i] = value;
+        }
+        return result;
+    }
+};
+
+} // namespace
+
+ImportedMesh importObj(const std::string& filename) {
+    std::vector<char> text = readFile(filename);
+    text.push_back('\0'); // strtof/strtol stop at the end
+
+    std::vector<std::array<float, 3>> positions;
+    std::vector<std::array<float, 3>> normals;
+    std::vector<std::array<float, 2>> uvs;
+
+    ImportedMesh mesh;
+    std::unordered_map<ObjCorner, uint32_t, ObjCornerHash> vertexIndices;
+    std::vector<uint32_t> polygon;
+
+    char* cursor = text.data();
+    char* end = text.data() + text.size() - 1;
+    while (cursor < end) {
+        char* lineEnd = static_cast<char*>(std::memchr(cursor, '\n', static_cast<size_t>(end - cursor)));
+        if (lineEnd == nullptr) {
+            lineEnd = end;
+        }
+        *lineEnd = '\0';
+        char* line = cursor;
+        cursor = lineEnd + 1;
+
+        while (*line == ' ' || *line == '\t') {
+            line++;
+        }
+        if (line[0] == 'v' && (line[1] == ' ' || line[1] == '\t')) {
+            std::array<float, 3> p{};
+            char* next = line + 1;
+            for (float& component : p) {
+                component = std::strtof(next, &next);
+            }
+            positions.push_back(p);
+        } else if (line[0] == 'v' && line[1] == 'n') {
+            std::array<float, 3> n{};
+            char* next = line + 2;
+            for (float& component : n) {
+                component = std::strtof(next, &next);
+            }
+            normals.push_back(n);
+        } else if (line[0] == 'v' && line[1] == 't') {
+            std::array<float, 2> uv{};
+            char* next = line + 2;
+            for (float& component : uv) {
+                component = std::strtof(next, &next);
+            }
+            uvs.push_back(uv);
+        } else if (line[0] == 'f' && (line[1] == ' ' || line[1] == '\t')) {
+            polygon.clear();
+            char* next = line + 1;
+            while (true) {
+                while (*next == ' ' || *next == '\t' || *next == '\r') {
+                    next++;
+                }
+                if (*next == '\0') {
+                    break;
+                }
+
+                // v, v/vt, v//vn or v/vt/vn
+                ObjCorner corner{resolveObjIndex(std::strtol(next, &next, 10), positions.size()), -1, -1};
+                if (*next == '/') {
+                    next++;
+                    if (*next != '/') {
+                        corner.uv = resolveObjIndex(std::strtol(next, &next, 10), uvs.size());
+                    }
+                    if (*next == '/') {
+                        next++;
+                        corner.normal = resolveObjIndex(std::strtol(next, &next, 10), normals.size());
+                    }
+                }
+                while (*next != '\0' && *next != ' ' && *next != '\t' && *next != '\r') {
+                    next++; // skip anything unparsable
+                }
+
+                if (corner.position < 0 || static_cast<size_t>(corner.position) >= positions.size()
+                    || static_cast<size_t>(corner.uv + 1) > uvs.size() || static_cast<size_t>(corner.normal + 1) > normals.size()) {
+                    throw std::runtime_error(filename + " has a face index out of range!");
+                }
+
+                auto [entry, inserted] = vertexIndices.try_emplace(corner, static_cast<uint32_t>(mesh.positions.size()));
+                if (inserted) {
+                    mesh.positions.push_back(positions[static_cast<size_t>(corner.position)]);
+                    mesh.uvs.push_back(corner.uv >= 0 ? uvs[static_cast<size_t>(corner.uv)] : std::array<float, 2>{0.0f, 0.0f});
+                    mesh.normals.push_back(corner.normal >= 0 ? normals[static_cast<size_t>(corner.normal)] : std::array<float, 3>{0.0f, 0.0f, 0.0f});
+                }
+                polygon.push_back(entry->second);
+            }
+
+            for (size_t i = 1; i + 1 < polygon.size(); i++) {
+                mesh.indices.push_back(polygon[0]);
+                mesh.indices.push_back(polygon[i]);
+                mesh.indices.push_back(polygon[i + 1]);
+            }
+        }
+    }
+
+    if (mesh.indices.empty()) {
+        throw std::runtime_error(filename + " has no faces!");
+    }
+    if (uvs.empty()) {
+        mesh.uvs.clear();
+    }
+    if (normals.empty()) {
+        mesh.normals.clear();
+    }
+    return mesh;
+}
+
+ImportedMesh importGltf(const std::string& filename) {
+    return GltfImporter(filename).import();
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Indexed triangle mesh with float attributes, as read from a source file. normals and
+// uvs are either empty or as long as positions.
+struct ImportedMesh {
+    std::vector<std::array<float, 3>> positions;
+    std::vector<std::array<float, 3>> normals;
+    std::vector<std::array<float, 2>> uvs;
+    std::vector<uint32_t> indices;
+    ImportedMesh(
+        std::vector<std::array<float, 3>> positions = {},
+        std::vector<std::array<float, 3>> normals = {},
+        std::vector<std::array<float, 2>> uvs = {},
+        std::vector<uint32_t> indices = {})
+        : positions(positions)
+        , normals(normals)
+        , uvs(uvs)
+        , indices(indices)
+    {}
+};
+
+// Wavefront OBJ: v, vt, vn and f (polygons are fanned into triangles); everything else,
+// materials included, is ignored. Corners sharing position, uv and normal become one vertex.
+ImportedMesh importObj(const std::string& filename);
+
+// glTF 2.0, as .gltf (buffers in files next to it or in data URIs) or .glb. Every triangle
+// primitive of the default scene is merged into one mesh, transformed by its node.
+ImportedMesh importGltf(const std::string& filename);
@@ -0,0 +1,493 @@
+// Converts OBJ and glTF meshes to the .mesh format (mesh_format.hpp) that loadMesh copies
+// to the GPU without parsing: quantized vertices, vertex cache optimized indices and meshlets.
+//
+//   tools/meshconv model.obj|model.gltf|model.glb model.mesh
+
+#include "mesh_format.hpp"
+#include "mesh_import.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+// Simulated post-transform cache of the vertex cache optimization (Tom Forsyth, "Linear-Speed
+// Vertex Cache Optimisation"). Larger than any real FIFO, which the result still suits well.
+const size_t CACHE_SIZE = 32;
+
+// For the reported ACMR (average cache misses per triangle), a typical hardware FIFO.
+const size_t FIFO_SIZE = 16;
+
+float vertexScore(int cachePosition, uint32_t remainingTriangles) {
+    if (remainingTriangles == 0) {
+        return -1.0f;
+    }
+
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        // The last triangle's vertices score the same: the order it was emitted in does not matter.
+        score = cachePosition < 3 ? 0.75f : std::pow(1.0f - static_cast<float>(cachePosition - 3) / static_cast<float>(CACHE_SIZE - 3), 1.5f);
+    }
+    // Vertices with few triangles left go first, so that they do not end up alone.
+    return score + 2.0f / std::sqrt(static_cast<float>(remainingTriangles));
+}
+
+std::vector<uint32_t> optimizeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount) {
+    size_t triangleCount = indices.size() / 3;
+
+    // Triangles using each vertex that are not emitted yet: adjacency[adjacencyStart[v]...] with
+    // remaining[v] entries.
+    std::vector<uint32_t> remaining(vertexCount, 0);
+    for (uint32_t index : indices) {
+        remaining[index]++;
+    }
+    std::vector<uint32_t> adjacencyStart(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++) {
+        adjacencyStart[v + 1] = adjacencyStart[v] + remaining[v];
+    }
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> filled(vertexCount, 0);
+    for (size_t i = 0; i < indices.size(); i++) {
+        uint32_t v = indices[i];
+        adjacency[adjacencyStart[v] + filled[v]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> scores(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) {
+        scores[v] = vertexScore(-1, remaining[v]);
+    }
+    std::vector<float> triangleScores(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    for (size_t t = 0; t < triangleCount; t++) {
+        triangleScores[t] = scores[indices[3 * t]] + scores[indices[3 * t + 1]] + scores[indices[3 * t + 2]];
+    }
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    std::vector<uint32_t> cache;
+    std::vector<uint32_t> newCache;
+    cache.reserve(CACHE_SIZE + 3);
+    newCache.reserve(CACHE_SIZE + 3);
+
+    size_t best = static_cast<size_t>(std::max_element(triangleScores.begin(), triangleScores.end()) - triangleScores.begin());
+    size_t nextUnemitted = 0;
+    while (result.size() < indices.size()) {
+        if (best == triangleCount) {
+            // Nothing in the cache has triangles left: continue with the next one in input order.
+            while (emitted[nextUnemitted]) {
+                nextUnemitted++;
+            }
+            best = nextUnemitted;
+        }
+
+        emitted[best] = true;
+        newCache.clear();
+        for (size_t corner = 0; corner < 3; corner++) {
+            uint32_t v = indices[3 * best + corner];
+            result.push_back(v);
+
+            // Remove the triangle from the vertex's remaining ones.
+            uint32_t* begin = adjacency.data() + adjacencyStart[v];
+            uint32_t* end = begin + remaining[v];
+            uint32_t* found = std::find(begin, end, static_cast<uint32_t>(best));
+            if (found != end) {
+                *found = *(end - 1);
+                remaining[v]--;
+            }
+
+            if (std::find(newCache.begin(), newCache.end(), v) == newCache.end()) {
+                newCache.push_back(v);
+            }
+        }
+        for (uint32_t v : cache) {
+            if (std::find(newCache.begin(), newCache.end(), v) == newCache.end()) {
+                newCache.push_back(v);
+            }
+        }
+
+        // Rescore everything that is or was in the cache, then the triangles around it.
+        for (size_t position = 0; position < newCache.size(); position++) {
+            uint32_t v = newCache[position];
+            cachePosition[v] = position < CACHE_SIZE ? static_cast<int>(position) : -1;
+            scores[v] = vertexScore(cachePosition[v], remaining[v]);
+        }
+        best = triangleCount;
+        float bestScore = -1.0f;
+        for (uint32_t v : newCache) {
+            for (uint32_t i = 0; i < remaining[v]; i++) {
+                uint32_t t = adjacency[adjacencyStart[v] + i];
+                triangleScores[t] = scores[indices[3 * t]] + scores[indices[3 * t + 1]] + scores[indices[3 * t + 2]];
+                if (triangleScores[t] > bestScore) {
+                    bestScore = triangleScores[t];
+                    best = t;
+                }
+            }
+        }
+
+        newCache.resize(std::min(newCache.size(), CACHE_SIZE));
+        std::swap(cache, newCache);
+    }
+    return result;
+}
+
+double averageCacheMissRatio(const std::vector<uint32_t>& indices, size_t vertexCount) {
+    std::vector<size_t> insertedAt(vertexCount, 0); // FIFO "time" + 1 of the vertex's insertion, 0 if never
+    size_t time = 0;
+    size_t misses = 0;
+    for (uint32_t v : indices) {
+        if (insertedAt[v] == 0 || time - (insertedAt[v] - 1) >= FIFO_SIZE) {
+            insertedAt[v] = ++time;
+            misses++;
+        }
+    }
+    return static_cast<double>(misses) / static_cast<double>(indices.size() / 3);
+}
+
+// Reorders the vertices by their first use, so the indices walk through memory forward.
+void optimizeVertexFetch(ImportedMesh& mesh) {
+    const uint32_t unused = ~0u;
+    std::vector<uint32_t> remap(mesh.positions.size(), unused);
+    uint32_t nextVertex = 0;
+    for (uint32_t& index : mesh.indices) {
+        if (remap[index] == unused) {
+            remap[index] = nextVertex++;
+        }
+        index = remap[index];
+    }
+
+    ImportedMesh reordered;
+    reordered.positions.resize(nextVertex);
+    reordered.normals.resize(nextVertex);
+    reordered.uvs.resize(mesh.uvs.empty() ? 0 : nextVertex);
+    for (size_t v = 0; v < remap.size(); v++) {
+        if (remap[v] != unused) {
+            reordered.positions[remap[v]] = mesh.positions[v];
+            reordered.normals[remap[v]] = mesh.normals[v];
+            if (!mesh.uvs.empty()) {
+                reordered.uvs[remap[v]] = mesh.uvs[v];
+            }
+        }
+    }
+    reordered.indices = std::move(mesh.indices);
+    mesh = std::move(reordered);
+}
+
+std::array<float, 3> subtract(const std::array<float, 3>& a, const std::array<float, 3>& b) {
+    return {a[0] - b[0], a[1] - b[1], a[2] - b[2]};
+}
+
+std::array<float, 3> cross(const std::array<float, 3>& a, const std::array<float, 3>& b) {
+    return {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+}
+
+float length(const std::array<float, 3>& v) {
+    return std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+}
+
+// Vertices without a normal get the area weighted average of their triangles' normals.
+void generateMissingNormals(ImportedMesh& mesh) {
+    if (mesh.normals.empty()) {
+        mesh.normals.assign(mesh.positions.size(), {0.0f, 0.0f, 0.0f});
+    }
+    std::vector<bool> missing(mesh.positions.size());
+    bool anyMissing = false;
+    for (size_t v = 0; v < mesh.normals.size(); v++) {
+        missing[v] = length(mesh.normals[v]) == 0.0f;
+        anyMissing = anyMissing || missing[v];
+    }
+    if (!anyMissing) {
+        return;
+    }
+
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+        const auto& p0 = mesh.positions[mesh.indices[i]];
+        // Not normalized: the cross product's length is twice the triangle's area.
+        std::array<float, 3> normal = cross(subtract(mesh.positions[mesh.indices[i + 1]], p0), subtract(mesh.positions[mesh.indices[i + 2]], p0));
+        for (size_t corner = 0; corner < 3; corner++) {
+            uint32_t v = mesh.indices[i + corner];
+            if (missing[v]) {
+                for (size_t c = 0; c < 3; c++) {
+                    mesh.normals[v][c] += normal[c];
+                }
+            }
+        }
+    }
+    for (size_t v = 0; v < mesh.normals.size(); v++) {
+        float normalLength = length(mesh.normals[v]);
+        if (missing[v] && normalLength > 0.0f) {
+            for (float& c : mesh.normals[v]) {
+                c /= normalLength;
+            }
+        }
+    }
+}
+
+struct Meshlets {
+    std::vector<MeshMeshlet> meshlets;
+    std::vector<uint32_t> vertices;
+    std::vector<uint8_t> triangles;
+    Meshlets()
+        : meshlets()
+        , vertices()
+        , triangles()
+    {}
+};
+
+// Greedily cuts the (cache optimized, so already local) triangle order into meshlets.
+Meshlets buildMeshlets(const ImportedMesh& mesh) {
+    Meshlets result;
+    const uint8_t absent = 0xff;
+    std::vector<uint8_t> localIndex(mesh.positions.size(), absent);
+    MeshMeshlet current{};
+
+    auto finish = [&]() {
+        if (current.triangleCount == 0) {
+            return;
+        }
+        std::array<float, 3> lower = mesh.positions[result.vertices[current.vertexOffset]];
+        std::array<float, 3> upper = lower;
+        for (uint32_t i = 0; i < current.vertexCount; i++) {
+            uint32_t v = result.vertices[current.vertexOffset + i];
+            localIndex[v] = absent;
+            for (size_t c = 0; c < 3; c++) {
+                lower[c] = std::min(lower[c], mesh.positions[v][c]);
+                upper[c] = std::max(upper[c], mesh.positions[v][c]);
+            }
+        }
+        for (size_t c = 0; c < 3; c++) {
+            current.center[c] = (lower[c] + upper[c]) * 0.5f;
+        }
+        std::array<float, 3> center = {current.center[0], current.center[1], current.center[2]};
+        current.radius = 0.0f;
+        for (uint32_t i = 0; i < current.vertexCount; i++) {
+            current.radius = std::max(current.radius, length(subtract(mesh.positions[result.vertices[current.vertexOffset + i]], center)));
+        }
+
+        result.meshlets.push_back(current);
+        current = MeshMeshlet{};
+        current.vertexOffset = static_cast<uint32_t>(result.vertices.size());
+        current.triangleOffset = static_cast<uint32_t>(result.triangles.size());
+    };
+
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+        uint32_t newVertices = 0;
+        for (size_t corner = 0; corner < 3; corner++) {
+            uint32_t v = mesh.indices[i + corner];
+            bool repeated = corner > 0 && (mesh.indices[i] == v || (corner == 2 && mesh.indices[i + 1] == v));
+            if (localIndex[v] == absent && !repeated) {
+                newVertices++;
+            }
+        }
+        if (current.vertexCount + newVertices > MESHLET_MAX_VERTICES || current.triangleCount + 1 > MESHLET_MAX_TRIANGLES) {
+            finish();
+        }
+
+        for (size_t corner = 0; corner < 3; corner++) {
+            uint32_t v = mesh.indices[i + corner];
+            if (localIndex[v] == absent) {
+                localIndex[v] = static_cast<uint8_t>(current.vertexCount++);
+                result.vertices.push_back(v);
+            }
+            result.triangles.push_back(localIndex[v]);
+        }
+        current.triangleCount++;
+    }
+    finish();
+    return result;
+}
+
+// IEEE 754 binary16, rounded to nearest even; out of range values become infinity.
+uint16_t toHalf(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t exponent = (bits >> 23) & 0xff;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    if (exponent == 0xff) {
+        return static_cast<uint16_t>(sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0)); // infinity, NaN
+    }
+    int halfExponent = static_cast<int>(exponent) - 127 + 15;
+    if (halfExponent >= 0x1f) {
+        return static_cast<uint16_t>(sign | 0x7c00);
+    }
+    if (halfExponent <= 0) {
+        if (halfExponent < -10) {
+            return static_cast<uint16_t>(sign); // below the smallest subnormal
+        }
+        mantissa |= 0x800000;
+        uint32_t shift = static_cast<uint32_t>(14 - halfExponent);
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1))) {
+            half++;
+        }
+        return static_cast<uint16_t>(sign | half);
+    }
+    uint32_t half = sign | (static_cast<uint32_t>(halfExponent) << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+        half++; // may carry into the exponent, which is still correct
+    }
+    return static_cast<uint16_t>(half);
+}
+
+int16_t toSnorm16(float value) {
+    return static_cast<int16_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+// Octahedral normal encoding: the unit sphere folded onto the [-1, 1] square.
+std::array<int16_t, 2> encodeNormal(const std::array<float, 3>& n) {
+    float sum = std::abs(n[0]) + std::abs(n[1]) + std::abs(n[2]);
+    if (sum == 0.0f) {
+        return {0, 0};
+    }
+    float x = n[0] / sum;
+    float y = n[1] / sum;
+    if (n[2] < 0.0f) {
+        float foldedX = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float foldedY = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = foldedX;
+        y = foldedY;
+    }
+    return {toSnorm16(x), toSnorm16(y)};
+}
+
+std::vector<MeshVertex> quantizeVertices(const ImportedMesh& mesh, MeshFileHeader& header) {
+    for (size_t c = 0; c < 3; c++) {
+        header.boundsMin[c] = mesh.positions[0][c];
+        header.boundsMax[c] = mesh.positions[0][c];
+    }
+    for (const auto& p : mesh.positions) {
+        for (size_t c = 0; c < 3; c++) {
+            header.boundsMin[c] = std::min(header.boundsMin[c], p[c]);
+            header.boundsMax[c] = std::max(header.boundsMax[c], p[c]);
+        }
+    }
+
+    std::vector<MeshVertex> vertices(mesh.positions.size());
+    for (size_t v = 0; v < vertices.size(); v++) {
+        MeshVertex& vertex = vertices[v];
+        for (size_t c = 0; c < 3; c++) {
+            float extent = header.boundsMax[c] - header.boundsMin[c];
+            float unit = extent > 0.0f ? (mesh.positions[v][c] - header.boundsMin[c]) / extent : 0.0f;
+            vertex.position[c] = static_cast<uint16_t>(std::lround(std::clamp(unit, 0.0f, 1.0f) * 65535.0f));
+        }
+        vertex.position[3] = 0;
+
+        std::array<int16_t, 2> normal = encodeNormal(mesh.normals[v]);
+        vertex.normal[0] = normal[0];
+        vertex.normal[1] = normal[1];
+
+        std::array<float, 2> uv = mesh.uvs.empty() ? std::array<float, 2>{0.0f, 0.0f} : mesh.uvs[v];
+        vertex.uv[0] = toHalf(uv[0]);
+        vertex.uv[1] = toHalf(uv[1]);
+    }
+    return vertices;
+}
+
+uint64_t alignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+void writeSection(std::ofstream& out, MeshFileHeader& header, MeshSection section, const void* data, size_t size) {
+    uint64_t offset = alignUp(static_cast<uint64_t>(out.tellp()), MESH_SECTION_ALIGNMENT);
+    while (static_cast<uint64_t>(out.tellp()) < offset) {
+        out.put('\0');
+    }
+    header.sections[section].offset = offset;
+    header.sections[section].size = size;
+    out.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+}
+
+void convert(const std::string& input, const std::string& output) {
+    std::string extension = std::filesystem::path(input).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return static_cast<char>(std::tolower(c)); });
+
+    ImportedMesh mesh;
+    if (extension == ".obj") {
+        mesh = importObj(input);
+    } else if (extension == ".gltf" || extension == ".glb") {
+        mesh = importGltf(input);
+    } else {
+        throw std::runtime_error("unknown input format " + extension + ", expected .obj, .gltf or .glb!");
+    }
+    if (mesh.positions.size() > std::numeric_limits<uint32_t>::max()) {
+        throw std::runtime_error(input + " has too many vertices!");
+    }
+
+    size_t inputVertexCount = mesh.positions.size();
+    double inputAcmr = averageCacheMissRatio(mesh.indices, mesh.positions.size());
+
+    generateMissingNormals(mesh);
+    mesh.indices = optimizeVertexCache(mesh.indices, mesh.positions.size());
+    optimizeVertexFetch(mesh);
+    Meshlets meshlets = buildMeshlets(mesh);
+
+    MeshFileHeader header{};
+    header.magic = MESH_FILE_MAGIC;
+    header.version = MESH_FILE_VERSION;
+    header.vertexCount = static_cast<uint32_t>(mesh.positions.size());
+    header.indexCount = static_cast<uint32_t>(mesh.indices.size());
+    header.meshletCount = static_cast<uint32_t>(meshlets.meshlets.size());
+    std::vector<MeshVertex> vertices = quantizeVertices(mesh, header);
+
+    // Any index fits into 16 bits below 65536 vertices.
+    std::vector<uint16_t> indices16;
+    if (header.vertexCount <= 65536) {
+        indices16.assign(mesh.indices.begin(), mesh.indices.end());
+    } else {
+        header.flags |= MESH_FLAG_32BIT_INDICES;
+    }
+
+    std::ofstream out(output, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        throw std::runtime_error("failed to open " + output + " for writing!");
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header)); // rewritten with the section table below
+    writeSection(out, header, MESH_SECTION_VERTICES, vertices.data(), vertices.size() * sizeof(MeshVertex));
+    if (indices16.empty()) {
+        writeSection(out, header, MESH_SECTION_INDICES, mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+    } else {
+        writeSection(out, header, MESH_SECTION_INDICES, indices16.data(), indices16.size() * sizeof(uint16_t));
+    }
+    writeSection(out, header, MESH_SECTION_MESHLETS, meshlets.meshlets.data(), meshlets.meshlets.size() * sizeof(MeshMeshlet));
+    writeSection(out, header, MESH_SECTION_MESHLET_VERTICES, meshlets.vertices.data(), meshlets.vertices.size() * sizeof(uint32_t));
+    writeSection(out, header, MESH_SECTION_MESHLET_TRIANGLES, meshlets.triangles.data(), meshlets.triangles.size());
+    uint64_t fileSize = static_cast<uint64_t>(out.tellp());
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!out) {
+        throw std::runtime_error("failed to write " + output + "!");
+    }
+
+    std::cout << input << ": " << inputVertexCount << " vertices, " << mesh.indices.size() / 3 << " triangles\n"
+              << output << ": " << header.vertexCount << " vertices (" << sizeof(MeshVertex) << " bytes each), "
+              << header.meshletCount << " meshlets, " << fileSize << " bytes\n"
+              << "ACMR (FIFO " << FIFO_SIZE << "): " << inputAcmr << " -> " << averageCacheMissRatio(mesh.indices, mesh.positions.size()) << "\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        std::cerr << "usage: " << argv[0] << " INPUT.obj|INPUT.gltf|INPUT.glb OUTPUT.mesh\n";
+        return EXIT_FAILURE;
+    }
+
+    try {
+        convert(argv[1], argv[2]);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
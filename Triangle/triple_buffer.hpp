@@ -0,0 +1,52 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Lock-free single producer, single consumer handoff of the latest value. The writer
+// fills writeBuffer() and publish()es it; the reader calls update() and then reads
+// the newest published value from readBuffer(). Neither side ever waits: the writer may
+// overwrite values the reader never saw, and the reader keeps the last value until a
+// new one arrives.
+template <typename T>
+class TripleBuffer {
+public:
+    TripleBuffer()
+        : buffers()
+        , backIndex(0)
+        , middle(1)
+        , frontIndex(2)
+    {}
+
+    TripleBuffer(const TripleBuffer& source) = delete;
+    TripleBuffer& operator=(const TripleBuffer& source) = delete;
+
+    // Writer thread only.
+    T& writeBuffer() { return buffers[backIndex]; }
+
+    void publish() {
+        backIndex = middle.exchange(static_cast<uint8_t>(backIndex | FRESH_BIT), std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    // Reader thread only. Returns true if a new value was published since the last update().
+    bool update() {
+        if ((middle.load(std::memory_order_relaxed) & FRESH_BIT) == 0) {
+            return false;
+        }
+        frontIndex = middle.exchange(frontIndex, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+
+    const T& readBuffer() const { return buffers[frontIndex]; }
+
+private:
+    static constexpr uint8_t INDEX_MASK = 0x3;
+    static constexpr uint8_t FRESH_BIT = 0x4; // set in middle when the writer published it and the reader has not taken it
+
+    std::array<T, 3> buffers;
+    // Each side's index on its own cache line so the threads do not false share.
+    alignas(64) uint8_t backIndex;
+    alignas(64) std::atomic<uint8_t> middle;
+    alignas(64) uint8_t frontIndex;
+};